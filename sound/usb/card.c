@@ -20,6 +20,7 @@
  */
 
 
+#include <linux/async.h>
 #include <linux/bitops.h>
 #include <linux/init.h>
 #include <linux/list.h>
@@ -29,6 +30,8 @@
 #include <linux/usb.h>
 #include <linux/moduleparam.h>
 #include <linux/mutex.h>
+#include <linux/pm_runtime.h>
+#include <linux/workqueue.h>
 #include <linux/usb/audio.h>
 #include <linux/usb/audio-v2.h>
 #include <linux/usb/audio-v3.h>
@@ -50,8 +53,10 @@
 #include "quirks.h"
 #include "endpoint.h"
 #include "helper.h"
+#include "clock.h"
 #include "pcm.h"
 #include "format.h"
+#include "implicit.h"
 #include "power.h"
 #include "stream.h"
 #include "media.h"
@@ -77,6 +82,7 @@ static unsigned int quirk_flags[SNDRV_CARDS];
 
 bool snd_usb_use_vmalloc = true;
 bool snd_usb_skip_validation;
+unsigned int snd_usb_reprobe_cache_secs;
 
 module_param_array(index, int, NULL, 0444);
 MODULE_PARM_DESC(index, "Index value for the USB audio adapter.");
@@ -109,6 +115,8 @@ module_param_named(use_vmalloc, snd_usb_use_vmalloc, bool, 0444);
 MODULE_PARM_DESC(use_vmalloc, "Use vmalloc for PCM intermediate buffers (default: yes).");
 module_param_named(skip_validation, snd_usb_skip_validation, bool, 0444);
 MODULE_PARM_DESC(skip_validation, "Skip unit descriptor validation (default: no).");
+module_param_named(reprobe_cache_secs, snd_usb_reprobe_cache_secs, uint, 0644);
+MODULE_PARM_DESC(reprobe_cache_secs, "Seconds to keep probe data of a disconnected device for a reconnect (default: 0 = off).");
 
 /*
  * we keep the snd_usb_audio_t instances by ourselves for merging
@@ -484,8 +492,10 @@ static void snd_usb_audio_free(struct snd_card *card)
 {
 	struct snd_usb_audio *chip = card->private_data;
 
+	cancel_delayed_work_sync(&chip->pm_linger_work);
 	snd_usb_endpoint_free_all(chip);
 	snd_usb_midi_v2_free_all(chip);
+	snd_usb_ctl_cache_free(chip);
 
 	mutex_destroy(&chip->mutex);
 	if (!atomic_read(&chip->shutdown))
@@ -590,6 +600,65 @@ static void usb_audio_make_longname(struct usb_device *dev,
 	}
 }
 
+/*
+ * Keep-warm policy
+ *
+ * The policy holds an autopm reference of its own, either permanently
+ * (SND_USB_PM_WARM) or for pm_linger seconds after a PCM close
+ * (SND_USB_PM_LINGER), so that the next open doesn't pay for a resume.
+ * SND_USB_PM_AGGRESSIVE leaves it all to the USB core.
+ */
+static void snd_usb_pm_hold(struct snd_usb_audio *chip, bool hold)
+{
+	lockdep_assert_held(&chip->pm_mutex);
+	if (hold == chip->pm_held)
+		return;
+	if (hold) {
+		if (snd_usb_autoresume(chip) < 0)
+			return;
+	} else {
+		snd_usb_autosuspend(chip);
+	}
+	chip->pm_held = hold;
+}
+
+static void snd_usb_pm_linger_work(struct work_struct *work)
+{
+	struct snd_usb_audio *chip =
+		container_of(work, struct snd_usb_audio, pm_linger_work.work);
+
+	mutex_lock(&chip->pm_mutex);
+	if (chip->pm_policy == SND_USB_PM_LINGER)
+		snd_usb_pm_hold(chip, false);
+	mutex_unlock(&chip->pm_mutex);
+}
+
+void snd_usb_pm_set_policy(struct snd_usb_audio *chip, int policy,
+			   unsigned int linger)
+{
+	cancel_delayed_work_sync(&chip->pm_linger_work);
+	mutex_lock(&chip->pm_mutex);
+	chip->pm_policy = policy;
+	chip->pm_linger = linger;
+	snd_usb_pm_hold(chip, policy == SND_USB_PM_WARM);
+	mutex_unlock(&chip->pm_mutex);
+}
+
+/* called at PCM close, before dropping the PCM's own autopm reference */
+void snd_usb_pm_linger(struct snd_usb_audio *chip)
+{
+	mutex_lock(&chip->pm_mutex);
+	/* the work was cancelled at disconnect; don't re-arm it */
+	if (!atomic_read(&chip->shutdown) &&
+	    chip->pm_policy == SND_USB_PM_LINGER && chip->pm_linger) {
+		snd_usb_pm_hold(chip, true);
+		if (chip->pm_held)
+			mod_delayed_work(system_wq, &chip->pm_linger_work,
+					 chip->pm_linger * HZ);
+	}
+	mutex_unlock(&chip->pm_mutex);
+}
+
 /*
  * create a chip instance and set its names.
  */
@@ -628,6 +697,10 @@ static int snd_usb_audio_create(struct usb_interface *intf,
 	chip = card->private_data;
 	mutex_init(&chip->mutex);
 	init_waitqueue_head(&chip->shutdown_wait);
+	mutex_init(&chip->pm_mutex);
+	INIT_DELAYED_WORK(&chip->pm_linger_work, snd_usb_pm_linger_work);
+	chip->pm_linger = 5;
+	chip->pd_budget_us = -1;
 	chip->index = idx;
 	chip->dev = dev;
 	chip->card = card;
@@ -635,6 +708,10 @@ static int snd_usb_audio_create(struct usb_interface *intf,
 	chip->generic_implicit_fb = implicit_fb[idx];
 	chip->autoclock = autoclock;
 	chip->lowlatency = lowlatency;
+	chip->tune.iface_delay = 50;
+	chip->tune.skip_packets = -1;
+	chip->tune.tenor_fb = -1;
+	chip->tune.complete_cpu = -1;
 	atomic_set(&chip->active, 1); /* avoid autopm during probing */
 	atomic_set(&chip->usage_count, 0);
 	atomic_set(&chip->shutdown, 0);
@@ -647,11 +724,15 @@ static int snd_usb_audio_create(struct usb_interface *intf,
 	INIT_LIST_HEAD(&chip->midi_list);
 	INIT_LIST_HEAD(&chip->midi_v2_list);
 	INIT_LIST_HEAD(&chip->mixer_list);
+	spin_lock_init(&chip->ctl_cache_lock);
+	INIT_LIST_HEAD(&chip->ctl_cache);
+	snd_usb_ctl_cache_restore(chip);
 
 	if (quirk_flags[idx])
 		chip->quirk_flags = quirk_flags[idx];
 	else
 		snd_usb_init_quirk_flags(chip);
+	snd_usb_clock_lock_init(chip);
 
 	card->private_free = snd_usb_audio_free;
 
@@ -812,7 +893,14 @@ static int usb_audio_probe(struct usb_interface *intf,
 		}
 	}
 	if (! chip) {
+		/*
+		 * Boot scripts may take seconds; don't hold up the probe of
+		 * other devices meanwhile.  The interfaces of this device are
+		 * probed one by one, so nobody else can register it.
+		 */
+		mutex_unlock(&register_mutex);
 		err = snd_usb_apply_boot_quirk_once(dev, intf, quirk, id);
+		mutex_lock(&register_mutex);
 		if (err < 0)
 			goto __error;
 
@@ -893,6 +981,8 @@ static int usb_audio_probe(struct usb_interface *intf,
 		chip->need_delayed_register = false; /* clear again */
 	}
 
+	snd_usb_setup_implicit_fb_links(chip);
+
 	err = try_to_register_card(chip, ifnum);
 	if (err < 0)
 		goto __error_no_register;
@@ -952,11 +1042,14 @@ static void usb_audio_disconnect(struct usb_interface *intf)
 		struct snd_usb_endpoint *ep;
 		struct usb_mixer_interface *mixer;
 
+		cancel_delayed_work_sync(&chip->pm_linger_work);
+
 		/* wait until all pending tasks done;
 		 * they are protected by snd_usb_lock_shutdown()
 		 */
 		wait_event(chip->shutdown_wait,
 			   !atomic_read(&chip->usage_count));
+		snd_usb_ctl_cache_stash(chip);
 		snd_card_disconnect(card);
 		/* release the pcm resources */
 		list_for_each_entry(as, &chip->pcm_list, list) {
@@ -1027,8 +1120,23 @@ void snd_usb_unlock_shutdown(struct snd_usb_audio *chip)
 		wake_up(&chip->shutdown_wait);
 }
 
+static void snd_usb_pm_account_resume(struct snd_usb_audio *chip,
+				      ktime_t start)
+{
+	struct snd_usb_pm_stats *st = &chip->pm_stats;
+	unsigned int us = ktime_us_delta(ktime_get(), start);
+
+	st->resumes++;
+	st->total_us += us;
+	st->last_us = us;
+	if (us > st->max_us)
+		st->max_us = us;
+}
+
 int snd_usb_autoresume(struct snd_usb_audio *chip)
 {
+	ktime_t start = ktime_get();
+	bool suspended;
 	int i, err;
 
 	if (atomic_read(&chip->shutdown))
@@ -1036,6 +1144,7 @@ int snd_usb_autoresume(struct snd_usb_audio *chip)
 	if (atomic_inc_return(&chip->active) != 1)
 		return 0;
 
+	suspended = pm_runtime_status_suspended(&chip->dev->dev);
 	for (i = 0; i < chip->num_interfaces; i++) {
 		err = usb_autopm_get_interface(chip->intf[i]);
 		if (err < 0) {
@@ -1046,6 +1155,8 @@ int snd_usb_autoresume(struct snd_usb_audio *chip)
 			return err;
 		}
 	}
+	if (suspended)
+		snd_usb_pm_account_resume(chip, start);
 	return 0;
 }
 
@@ -1077,7 +1188,7 @@ static int usb_audio_suspend(struct usb_interface *intf, pm_message_t message)
 		list_for_each_entry(as, &chip->pcm_list, list)
 			snd_usb_pcm_suspend(as);
 		list_for_each_entry(ep, &chip->ep_list, list)
-			snd_usb_endpoint_suspend(ep);
+			snd_usb_endpoint_suspend(ep, PMSG_IS_AUTO(message));
 		list_for_each(p, &chip->midi_list)
 			snd_usbmidi_suspend(p);
 		list_for_each_entry(mixer, &chip->mixer_list, list)
@@ -1093,12 +1204,24 @@ static int usb_audio_suspend(struct usb_interface *intf, pm_message_t message)
 	return 0;
 }
 
+/* restore a mixer interface; run asynchronously from usb_audio_resume() */
+static void usb_audio_resume_mixer(void *data, async_cookie_t cookie)
+{
+	struct usb_mixer_interface *mixer = data;
+	int err;
+
+	err = snd_usb_mixer_resume(mixer);
+	if (err < 0)
+		WRITE_ONCE(mixer->chip->resume_err, err);
+}
+
 static int usb_audio_resume(struct usb_interface *intf)
 {
 	struct snd_usb_audio *chip = usb_get_intfdata(intf);
 	struct snd_usb_stream *as;
 	struct usb_mixer_interface *mixer;
 	struct list_head *p;
+	ASYNC_DOMAIN_EXCLUSIVE(mixer_domain);
 	int err = 0;
 
 	if (chip == USB_AUDIO_IFACE_UNUSED)
@@ -1108,6 +1231,7 @@ static int usb_audio_resume(struct usb_interface *intf)
 	if (chip->num_suspended_intf > 1)
 		goto out;
 
+	/* power domains first; mixer values may depend on the clock state */
 	list_for_each_entry(as, &chip->pcm_list, list) {
 		err = snd_usb_pcm_resume(as);
 		if (err < 0)
@@ -1116,13 +1240,14 @@ static int usb_audio_resume(struct usb_interface *intf)
 
 	/*
 	 * ALSA leaves material resumption to user space
-	 * we just notify and restart the mixers
+	 * we just notify and restart the mixers.
+	 * The mixer restore is a long chain of control messages, so let each
+	 * mixer interface run in parallel with the MIDI restart below.
 	 */
-	list_for_each_entry(mixer, &chip->mixer_list, list) {
-		err = snd_usb_mixer_resume(mixer);
-		if (err < 0)
-			goto err_out;
-	}
+	chip->resume_err = 0;
+	list_for_each_entry(mixer, &chip->mixer_list, list)
+		async_schedule_domain(usb_audio_resume_mixer, mixer,
+				      &mixer_domain);
 
 	list_for_each(p, &chip->midi_list) {
 		snd_usbmidi_resume(p);
@@ -1130,6 +1255,11 @@ static int usb_audio_resume(struct usb_interface *intf)
 
 	snd_usb_midi_v2_resume_all(chip);
 
+	async_synchronize_full_domain(&mixer_domain);
+	err = chip->resume_err;
+	if (err < 0)
+		goto err_out;
+
  out:
 	if (chip->num_suspended_intf == chip->system_suspend) {
 		snd_power_change_state(chip->card, SNDRV_CTL_POWER_D0);
@@ -1142,6 +1272,19 @@ err_out:
 	return err;
 }
 
+/* the device was reset, so the cached altset and clock state is gone */
+static int usb_audio_reset_resume(struct usb_interface *intf)
+{
+	struct snd_usb_audio *chip = usb_get_intfdata(intf);
+	struct snd_usb_endpoint *ep;
+
+	if (chip != USB_AUDIO_IFACE_UNUSED) {
+		list_for_each_entry(ep, &chip->ep_list, list)
+			snd_usb_endpoint_suspend(ep, false);
+	}
+	return usb_audio_resume(intf);
+}
+
 static const struct usb_device_id usb_audio_ids [] = {
 #include "quirks-table.h"
     { .match_flags = (USB_DEVICE_ID_MATCH_INT_CLASS | USB_DEVICE_ID_MATCH_INT_SUBCLASS),
@@ -1161,9 +1304,21 @@ static struct usb_driver usb_audio_driver = {
 	.disconnect =	usb_audio_disconnect,
 	.suspend =	usb_audio_suspend,
 	.resume =	usb_audio_resume,
-	.reset_resume =	usb_audio_resume,
+	.reset_resume =	usb_audio_reset_resume,
 	.id_table =	usb_audio_ids,
 	.supports_autosuspend = 1,
 };
 
-module_usb_driver(usb_audio_driver);
+static int __init usb_audio_init(void)
+{
+	return usb_register(&usb_audio_driver);
+}
+
+static void __exit usb_audio_cleanup(void)
+{
+	usb_deregister(&usb_audio_driver);
+	snd_usb_ctl_cache_cleanup();
+}
+
+module_init(usb_audio_init);
+module_exit(usb_audio_cleanup);
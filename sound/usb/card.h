@@ -2,11 +2,14 @@
 #ifndef __USBAUDIO_CARD_H
 #define __USBAUDIO_CARD_H
 
+#include "ep_stats.h"
+
 #define MAX_NR_RATES	1024
 #define MAX_PACKS	6		/* per URB */
 #define MAX_PACKS_HS	(MAX_PACKS * 8)	/* in high speed mode */
 #define MAX_URBS	12
-#define SYNC_URBS	4	/* always four urbs for sync */
+#define SYNC_URBS	4	/* urbs for sync, fewer when batching */
+#define MAX_SYNC_PACKS	8	/* feedback packets per sync urb */
 #define MAX_QUEUE	18	/* try not to exceed this queue length, in ms */
 
 struct audioformat {
@@ -28,6 +31,8 @@ struct audioformat {
 	unsigned char sync_iface;	/* sync EP interface */
 	unsigned char sync_altsetting;	/* sync EP alternate setting */
 	unsigned char sync_ep_idx;	/* sync EP array index */
+	struct snd_usb_endpoint *sync_endpoint;	/* resolved sync EP object */
+	struct snd_usb_substream *sync_subs;	/* implicit fb partner stream */
 	unsigned char datainterval;	/* log_2 of data packet interval */
 	unsigned char protocol;		/* UAC_VERSION_1/2/3 */
 	unsigned int maxpacksize;	/* max. packet size */
@@ -42,6 +47,28 @@ struct audioformat {
 	bool dsd_raw;			/* altsetting is raw DSD */
 };
 
+/* URB completion history kept per endpoint for xrun analysis */
+#define EP_EVENT_HISTORY	32
+
+struct snd_usb_ep_event {
+	u64 time_ns;		/* completion time */
+	int status;		/* URB status */
+	unsigned int length;	/* URB actual_length */
+	unsigned char index;	/* URB index */
+	unsigned char submitted; /* URBs in flight */
+	unsigned char queued;	/* implicit fb next_packet FIFO depth */
+	bool late;		/* completed more than 2 URB periods after the last */
+};
+
+/* xrun causes counted per endpoint */
+enum {
+	SND_USB_XRUN_PREPARE,	/* no data to prepare, e.g. applptr starvation */
+	SND_USB_XRUN_SUBMIT,	/* URB (re)submission failed */
+	SND_USB_XRUN_FIFO,	/* implicit fb next_packet FIFO overflow */
+	SND_USB_XRUN_START,	/* no URB could be queued at start */
+	SND_USB_XRUN_REASONS
+};
+
 struct snd_usb_substream;
 struct snd_usb_iface_ref;
 struct snd_usb_clock_ref;
@@ -56,8 +83,9 @@ struct snd_urb_ctx {
 	int index;	/* index for urb array */
 	int packets;	/* number of packets per urb */
 	int queued;	/* queued data bytes by this urb */
-	int packet_size[MAX_PACKS_HS]; /* size of packets for next submission */
+	u16 *packet_size;	/* size of packets for next submission, playback only */
 	struct list_head ready_list;
+	struct list_head complete_list;	/* for deferred completion */
 };
 
 struct snd_usb_endpoint {
@@ -88,20 +116,31 @@ struct snd_usb_endpoint {
 
 	struct snd_urb_ctx urb[MAX_URBS];
 
+	/* per-packet sizes of all URBs and ring slots, allocated at hw_params */
+	void *packet_meta;
 	struct snd_usb_packet_info {
-		uint32_t packet_size[MAX_PACKS_HS];
-		int packets;
-	} next_packet[MAX_URBS];
+		u16 *packet_size;
+		unsigned int packets;
+	} *next_packet;
+	unsigned int next_packet_slots; /* entries in the next_packet ring */
+	unsigned int next_packet_packs; /* packet sizes per ring entry */
 	unsigned int next_packet_head;	/* ring buffer offset to read */
 	unsigned int next_packet_queued; /* queued items in the ring buffer */
+	unsigned int next_packet_merges; /* entries folded on ring overflow */
+	unsigned int next_packet_dropped; /* frames lost while folding */
 	struct list_head ready_playback_urbs; /* playback URB FIFO for implicit fb */
 
 	unsigned int nurbs;		/* # urbs */
 	unsigned long active_mask;	/* bitmask of active urbs */
 	unsigned long unlink_mask;	/* bitmask of unlinked urbs */
 	atomic_t submitted_urbs;	/* currently submitted urbs */
-	char *syncbuf;			/* sync buffer for all sync URBs */
-	dma_addr_t sync_dma;		/* DMA address of syncbuf */
+	wait_queue_head_t drain_wait;	/* woken when submitted_urbs hits 0 */
+	/* coherent buffer for all URBs, kept across hw_params */
+	void *arena;
+	dma_addr_t arena_dma;
+	unsigned int arena_size;
+	unsigned int arena_allocs;	/* (re)allocations of the arena */
+	unsigned int arena_reuses;	/* set_params that reused it */
 
 	unsigned int pipe;		/* the data i/o pipe */
 	unsigned int packsize[2];	/* small/large packet sizes in samples */
@@ -111,6 +150,8 @@ struct snd_usb_endpoint {
 	unsigned int freqn;		/* nominal sampling rate in fs/fps in Q16.16 format */
 	unsigned int freqm;		/* momentary sampling rate in fs/fps in Q16.16 format */
 	int	   freqshift;		/* how much to shift the feedback value to get Q16.16 */
+	unsigned int fb_values;		/* feedback values received */
+	unsigned int fb_rejects;	/* ... and rejected as out of range */
 	unsigned int freqmax;		/* maximum sampling rate, used for buffer management */
 	unsigned int phase;		/* phase accumulator */
 	unsigned int maxpacksize;	/* max packet size in bytes */
@@ -145,6 +186,33 @@ struct snd_usb_endpoint {
 
 	spinlock_t lock;
 	struct list_head list;
+
+	/* optional deferral of URB completion work to a high-priority worker */
+	int complete_cpu;		/* CPU to run on, -1 = in the HCD context */
+	struct work_struct complete_work;
+	struct list_head complete_pending; /* completed URBs, in order */
+	int complete_last_cpu;		/* CPU of the last completion handling */
+	unsigned int complete_count;
+	u64 complete_total_ns;
+	unsigned int complete_max_ns;
+
+	/* live counters, published to snap under snap_seq */
+	u64 stat_urbs;
+	u64 stat_bytes;
+	unsigned int stat_xruns;
+	seqcount_t snap_seq;
+	struct snd_usb_ep_snapshot snap;
+
+	/* rolling URB history, frozen into xrun_hist at each xrun */
+	spinlock_t hist_lock;
+	struct snd_usb_ep_event hist[EP_EVENT_HISTORY];
+	unsigned int hist_pos;		/* total events recorded */
+	u64 last_complete_ns;
+	unsigned int xrun_count[SND_USB_XRUN_REASONS];
+	int xrun_reason;		/* reason of the last xrun */
+	u64 xrun_time_ns;
+	struct snd_usb_ep_event xrun_hist[EP_EVENT_HISTORY]; /* oldest first */
+	unsigned int xrun_hist_len;
 };
 
 struct media_ctl;
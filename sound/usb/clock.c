@@ -5,6 +5,7 @@
 
 #include <linux/bitops.h>
 #include <linux/init.h>
+#include <linux/ktime.h>
 #include <linux/string.h>
 #include <linux/usb.h>
 #include <linux/usb/audio.h>
@@ -146,14 +147,15 @@ static int uac_clock_selector_set_val(struct snd_usb_audio *chip, int selector_i
 	return ret;
 }
 
+static int snd_usb_clock_wait_lock(struct snd_usb_audio *chip,
+				   const struct audioformat *fmt,
+				   int clock, unsigned int timeout);
+
 static bool uac_clock_source_is_valid_quirk(struct snd_usb_audio *chip,
 					    const struct audioformat *fmt,
 					    int source_id)
 {
 	bool ret = false;
-	int count;
-	unsigned char data;
-	struct usb_device *dev = chip->dev;
 	union uac23_clock_source_desc *cs_desc;
 
 	cs_desc = snd_usb_find_clock_source(chip, source_id, fmt->protocol);
@@ -176,39 +178,21 @@ static bool uac_clock_source_is_valid_quirk(struct snd_usb_audio *chip,
 	}
 
 	/*
-	 * MOTU MicroBook IIc
-	 * Sample rate changes takes more than 2 seconds for this device. Clock
-	 * validity request returns false during that period.
+	 * Devices like the MOTU MicroBook IIc take seconds to lock after a
+	 * sample rate change and report an invalid clock meanwhile.
 	 */
-	if (chip->usb_id == USB_ID(0x07fd, 0x0004)) {
-		count = 0;
-
-		while ((!ret) && (count < 50)) {
-			int err;
-
-			msleep(100);
-
-			err = snd_usb_ctl_msg(dev, usb_rcvctrlpipe(dev, 0), UAC2_CS_CUR,
-					      USB_TYPE_CLASS | USB_RECIP_INTERFACE | USB_DIR_IN,
-					      UAC2_CS_CONTROL_CLOCK_VALID << 8,
-					      snd_usb_ctrl_intf(chip) | (source_id << 8),
-					      &data, sizeof(data));
-			if (err < 0) {
-				dev_warn(&dev->dev,
-					 "%s(): cannot get clock validity for id %d\n",
-					   __func__, source_id);
-				return false;
-			}
-
-			ret = !!data;
-			count++;
-		}
-	}
+	if (chip->tune.clock_lock_ms)
+		ret = !snd_usb_clock_wait_lock(chip, fmt, source_id,
+					       chip->tune.clock_lock_ms);
 
 	return ret;
 }
 
-static bool uac_clock_source_is_valid(struct snd_usb_audio *chip,
+/*
+ * Read the CLOCK_VALID control of the given clock source;
+ * returns 1 or 0, -ENOENT if the clock source can't tell, or a negative error
+ */
+static int uac_clock_source_get_valid(struct snd_usb_audio *chip,
 				      const struct audioformat *fmt,
 				      int source_id)
 {
@@ -220,17 +204,16 @@ static bool uac_clock_source_is_valid(struct snd_usb_audio *chip,
 
 	cs_desc = snd_usb_find_clock_source(chip, source_id, fmt->protocol);
 	if (!cs_desc)
-		return false;
+		return -EINVAL;
 
 	if (fmt->protocol == UAC_VERSION_3)
 		bmControls = le32_to_cpu(cs_desc->v3.bmControls);
 	else
 		bmControls = cs_desc->v2.bmControls;
 
-	/* If a clock source can't tell us whether it's valid, we assume it is */
 	if (!uac_v2v3_control_is_readable(bmControls,
 				      UAC2_CS_CONTROL_CLOCK_VALID))
-		return true;
+		return -ENOENT;
 
 	err = snd_usb_ctl_msg(dev, usb_rcvctrlpipe(dev, 0), UAC2_CS_CUR,
 			      USB_TYPE_CLASS | USB_RECIP_INTERFACE | USB_DIR_IN,
@@ -238,14 +221,123 @@ static bool uac_clock_source_is_valid(struct snd_usb_audio *chip,
 			      snd_usb_ctrl_intf(chip) | (source_id << 8),
 			      &data, sizeof(data));
 
+	/* polled while the clock settles; callers report the final error */
 	if (err < 0) {
-		dev_warn(&dev->dev,
-			 "%s(): cannot get clock validity for id %d\n",
-			   __func__, source_id);
+		dev_dbg(&dev->dev,
+			"%s(): cannot get clock validity for id %d\n",
+			__func__, source_id);
+		return err;
+	}
+
+	return !!data;
+}
+
+/*
+ * Clock lock waiter: the CLOCK_VALID control is polled from a worker with
+ * an exponentially growing interval (1ms up to 64ms), and the waiting
+ * caller is woken up as soon as the clock locks, reading the control
+ * fails, or the timeout expires.
+ */
+static void snd_usb_clock_lock_work(struct work_struct *work)
+{
+	struct snd_usb_clock_lock *lk =
+		container_of(to_delayed_work(work), struct snd_usb_clock_lock,
+			     work);
+	struct snd_usb_audio *chip =
+		container_of(lk, struct snd_usb_audio, clock_lock);
+	unsigned int elapsed;
+	int valid;
+
+	valid = uac_clock_source_get_valid(chip, lk->fmt, lk->clock);
+	if (valid) {
+		lk->result = valid < 0 ? valid : 0;
+		goto done;
+	}
+
+	elapsed = ktime_ms_delta(ktime_get(), lk->start);
+	if (elapsed >= lk->timeout) {
+		lk->result = -ETIMEDOUT;
+		goto done;
+	}
+	schedule_delayed_work(&lk->work,
+			      msecs_to_jiffies(min(lk->interval,
+						   lk->timeout - elapsed)));
+	lk->interval = min(lk->interval * 2, 64U);
+	return;
+
+ done:
+	complete(&lk->done);
+}
+
+/*
+ * Wait until the given clock source reports a valid clock; returns 0 once
+ * locked, -ETIMEDOUT after @timeout ms, or the error from the CLOCK_VALID
+ * request (-ENOENT if the clock can't tell).
+ */
+static int snd_usb_clock_wait_lock(struct snd_usb_audio *chip,
+				   const struct audioformat *fmt,
+				   int clock, unsigned int timeout)
+{
+	struct snd_usb_clock_lock *lk = &chip->clock_lock;
+	int err;
+
+	mutex_lock(&lk->mutex);
+	reinit_completion(&lk->done);
+	lk->fmt = fmt;
+	lk->clock = clock;
+	lk->timeout = timeout;
+	lk->interval = 1;
+	lk->start = ktime_get();
+	schedule_delayed_work(&lk->work, 0);
+	wait_for_completion(&lk->done);
+	err = lk->result;
+	lk->last_ms = ktime_ms_delta(ktime_get(), lk->start);
+	if (err == -ETIMEDOUT)
+		lk->timeouts++;
+	else if (!err && lk->last_ms > lk->max_ms)
+		lk->max_ms = lk->last_ms;
+	mutex_unlock(&lk->mutex);
+
+	if (err == -ETIMEDOUT)
+		usb_audio_warn(chip, "clock %d not locked after %u ms\n",
+			       clock, lk->last_ms);
+	else if (err < 0 && err != -ENOENT)
+		usb_audio_warn(chip, "cannot get clock validity for id %d\n",
+			       clock);
+	else
+		usb_audio_dbg(chip, "clock %d lock: %d after %u ms\n",
+			      clock, err, lk->last_ms);
+	return err;
+}
+
+void snd_usb_clock_lock_init(struct snd_usb_audio *chip)
+{
+	struct snd_usb_clock_lock *lk = &chip->clock_lock;
+
+	mutex_init(&lk->mutex);
+	INIT_DELAYED_WORK(&lk->work, snd_usb_clock_lock_work);
+	init_completion(&lk->done);
+	if (chip->quirk_flags & QUIRK_FLAG_CLOCK_LOCK_WAIT)
+		chip->tune.clock_lock_ms = 5000;
+}
+
+static bool uac_clock_source_is_valid(struct snd_usb_audio *chip,
+				      const struct audioformat *fmt,
+				      int source_id)
+{
+	int valid;
+
+	valid = uac_clock_source_get_valid(chip, fmt, source_id);
+	/* If a clock source can't tell us whether it's valid, we assume it is */
+	if (valid == -ENOENT)
+		return true;
+	if (valid < 0) {
+		usb_audio_warn(chip, "cannot get clock validity for id %d\n",
+			       source_id);
 		return false;
 	}
 
-	if (data)
+	if (valid)
 		return true;
 	else
 		return uac_clock_source_is_valid_quirk(chip, fmt, source_id);
@@ -579,7 +671,7 @@ static int set_sample_rate_v2v3(struct snd_usb_audio *chip,
 		if (cur_base_48k != prev_base_48k) {
 			usb_set_interface(chip->dev, fmt->iface, fmt->altsetting);
 			if (chip->quirk_flags & QUIRK_FLAG_IFACE_DELAY)
-				msleep(50);
+				snd_usb_clock_settle(chip, fmt);
 		}
 	}
 
@@ -590,6 +682,93 @@ validation:
 	return 0;
 }
 
+/*
+ * Resolve the clock source of @fmt without changing any selector: follow
+ * the current value of each selector and pass through multipliers.
+ */
+static int uac_clock_peek_source(struct snd_usb_audio *chip,
+				 const struct audioformat *fmt)
+{
+	union uac23_clock_source_desc *source;
+	union uac23_clock_selector_desc *selector;
+	union uac23_clock_multiplier_desc *multiplier;
+	DECLARE_BITMAP(visited, 256);
+	int proto = fmt->protocol;
+	int entity_id = fmt->clock;
+	int pins, cur;
+
+	memset(visited, 0, sizeof(visited));
+	for (;;) {
+		entity_id &= 0xff;
+		if (test_and_set_bit(entity_id, visited))
+			return -EINVAL;
+
+		source = snd_usb_find_clock_source(chip, entity_id, proto);
+		if (source)
+			return GET_VAL(source, proto, bClockID);
+
+		selector = snd_usb_find_clock_selector(chip, entity_id, proto);
+		if (selector) {
+			pins = GET_VAL(selector, proto, bNrInPins);
+			cur = 1;
+			if (pins > 1)
+				cur = uac_clock_selector_get_val(chip,
+						GET_VAL(selector, proto, bClockID));
+			if (cur < 1 || cur > pins)
+				return -EINVAL;
+			entity_id = GET_VAL(selector, proto, baCSourceID)[cur - 1];
+			continue;
+		}
+
+		multiplier = snd_usb_find_clock_multiplier(chip, entity_id,
+							   proto);
+		if (!multiplier)
+			return -EINVAL;
+		entity_id = GET_VAL(multiplier, proto, bCSourceID);
+	}
+}
+
+/*
+ * Wait for the device to settle after an altsetting switch on devices with
+ * QUIRK_FLAG_IFACE_DELAY.
+ *
+ * By default this sleeps for the whole iface_delay.  With iface_probe set,
+ * the clock lock waiter polls the clock validity of a UAC2/3 format and the
+ * wait ends as soon as the clock is reported valid; iface_delay is still
+ * the upper bound.  The measured time is recorded for the proc file.
+ */
+void snd_usb_clock_settle(struct snd_usb_audio *chip,
+			  const struct audioformat *fmt)
+{
+	unsigned int max_ms = chip->tune.iface_delay;
+	unsigned int elapsed;
+	ktime_t start = ktime_get();
+	int clock = -EINVAL;
+
+	if (chip->tune.iface_probe && fmt && fmt->protocol != UAC_VERSION_1 &&
+	    !(chip->quirk_flags & QUIRK_FLAG_IGNORE_CLOCK_SOURCE))
+		clock = uac_clock_peek_source(chip, fmt);
+
+	if (clock < 0) {
+		msleep(max_ms);
+		goto out;
+	}
+
+	/* errors and unreadable validity: fall back to the full delay */
+	if (snd_usb_clock_wait_lock(chip, fmt, clock, max_ms) < 0) {
+		elapsed = ktime_ms_delta(ktime_get(), start);
+		if (elapsed < max_ms)
+			msleep(max_ms - elapsed);
+	}
+
+ out:
+	elapsed = ktime_ms_delta(ktime_get(), start);
+	chip->iface_settle_last = elapsed;
+	if (elapsed > chip->iface_settle_max)
+		chip->iface_settle_max = elapsed;
+	usb_audio_dbg(chip, "interface settled after %u ms\n", elapsed);
+}
+
 int snd_usb_init_sample_rate(struct snd_usb_audio *chip,
 			     const struct audioformat *fmt, int rate)
 {
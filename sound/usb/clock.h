@@ -12,4 +12,9 @@ int snd_usb_set_sample_rate_v2v3(struct snd_usb_audio *chip,
 				 const struct audioformat *fmt,
 				 int clock, int rate);
 
+void snd_usb_clock_settle(struct snd_usb_audio *chip,
+			  const struct audioformat *fmt);
+
+void snd_usb_clock_lock_init(struct snd_usb_audio *chip);
+
 #endif /* __USBAUDIO_CLOCK_H */
@@ -5,9 +5,12 @@
 #include <linux/gfp.h>
 #include <linux/init.h>
 #include <linux/ratelimit.h>
+#include <linux/seqlock.h>
 #include <linux/usb.h>
 #include <linux/usb/audio.h>
 #include <linux/slab.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
 
 #include <sound/core.h>
 #include <sound/pcm.h>
@@ -96,10 +99,7 @@ static inline unsigned get_usb_high_speed_rate(unsigned int rate)
  */
 static void release_urb_ctx(struct snd_urb_ctx *u)
 {
-	if (u->urb && u->buffer_size)
-		usb_free_coherent(u->ep->chip->dev, u->buffer_size,
-				  u->urb->transfer_buffer,
-				  u->urb->transfer_dma);
+	/* the transfer buffer belongs to the endpoint's arena */
 	usb_free_urb(u->urb);
 	u->urb = NULL;
 	u->buffer_size = 0;
@@ -392,18 +392,40 @@ static int prepare_inbound_urb(struct snd_usb_endpoint *ep,
 		break;
 
 	case SND_USB_ENDPOINT_TYPE_SYNC:
-		urb->iso_frame_desc[0].length = min(4u, ep->syncmaxsize);
-		urb->iso_frame_desc[0].offset = 0;
+		for (i = 0; i < urb_ctx->packets; i++) {
+			urb->iso_frame_desc[i].length = min(4u, ep->syncmaxsize);
+			urb->iso_frame_desc[i].offset = i * 4;
+		}
 		break;
 	}
 	return 0;
 }
 
+/* count an xrun and freeze the URB history leading to it */
+static void record_xrun(struct snd_usb_endpoint *ep, int reason)
+{
+	unsigned long flags;
+	unsigned int i, n;
+
+	spin_lock_irqsave(&ep->hist_lock, flags);
+	ep->xrun_count[reason]++;
+	WRITE_ONCE(ep->stat_xruns, ep->stat_xruns + 1);
+	ep->xrun_reason = reason;
+	ep->xrun_time_ns = ktime_get_ns();
+	n = min_t(unsigned int, ep->hist_pos, EP_EVENT_HISTORY);
+	for (i = 0; i < n; i++)
+		ep->xrun_hist[i] =
+			ep->hist[(ep->hist_pos - n + i) % EP_EVENT_HISTORY];
+	ep->xrun_hist_len = n;
+	spin_unlock_irqrestore(&ep->hist_lock, flags);
+}
+
 /* notify an error as XRUN to the assigned PCM data substream */
-static void notify_xrun(struct snd_usb_endpoint *ep)
+static void notify_xrun(struct snd_usb_endpoint *ep, int reason)
 {
 	struct snd_usb_substream *data_subs;
 
+	record_xrun(ep, reason);
 	data_subs = READ_ONCE(ep->data_subs);
 	if (data_subs && data_subs->pcm_substream)
 		snd_pcm_stop_xrun(data_subs->pcm_substream);
@@ -415,7 +437,7 @@ next_packet_fifo_enqueue(struct snd_usb_endpoint *ep)
 	struct snd_usb_packet_info *p;
 
 	p = ep->next_packet + (ep->next_packet_head + ep->next_packet_queued) %
-		ARRAY_SIZE(ep->next_packet);
+		ep->next_packet_slots;
 	ep->next_packet_queued++;
 	return p;
 }
@@ -427,11 +449,42 @@ next_packet_fifo_dequeue(struct snd_usb_endpoint *ep)
 
 	p = ep->next_packet + ep->next_packet_head;
 	ep->next_packet_head++;
-	ep->next_packet_head %= ARRAY_SIZE(ep->next_packet);
+	ep->next_packet_head %= ep->next_packet_slots;
 	ep->next_packet_queued--;
 	return p;
 }
 
+/*
+ * Make room in a full implicit feedback ring by folding the oldest entry
+ * into the next one.  Its frames are spread over the packets of the next
+ * entry up to the packet size limit, so that the sink keeps up with the
+ * frame count of the source.  Returns the number of frames that didn't
+ * fit; the caller must treat those as an xrun.
+ */
+static unsigned int next_packet_fifo_merge(struct snd_usb_endpoint *ep)
+{
+	struct snd_usb_packet_info *src, *dst;
+	unsigned int frames = 0, limit, room, i;
+
+	limit = min_not_zero(ep->maxframesize, ep->curframesize);
+	src = next_packet_fifo_dequeue(ep);
+	dst = ep->next_packet + ep->next_packet_head;
+
+	for (i = 0; i < src->packets; i++)
+		frames += src->packet_size[i];
+	for (i = 0; i < dst->packets && frames; i++) {
+		if (dst->packet_size[i] >= limit)
+			continue;
+		room = min(limit - dst->packet_size[i], frames);
+		dst->packet_size[i] += room;
+		frames -= room;
+	}
+
+	ep->next_packet_merges++;
+	ep->next_packet_dropped += frames;
+	return frames;
+}
+
 static void push_back_to_ready_list(struct snd_usb_endpoint *ep,
 				    struct snd_urb_ctx *ctx)
 {
@@ -465,7 +518,7 @@ int snd_usb_queue_pending_output_urbs(struct snd_usb_endpoint *ep,
 		unsigned long flags;
 		struct snd_usb_packet_info *packet;
 		struct snd_urb_ctx *ctx = NULL;
-		int err, i;
+		int err;
 
 		spin_lock_irqsave(&ep->lock, flags);
 		if ((!implicit_fb || ep->next_packet_queued > 0) &&
@@ -483,10 +536,9 @@ int snd_usb_queue_pending_output_urbs(struct snd_usb_endpoint *ep,
 			break;
 
 		/* copy over the length information */
-		if (implicit_fb) {
-			for (i = 0; i < packet->packets; i++)
-				ctx->packet_size[i] = packet->packet_size[i];
-		}
+		if (implicit_fb)
+			memcpy(ctx->packet_size, packet->packet_size,
+			       packet->packets * sizeof(*ctx->packet_size));
 
 		/* call the data handler to fill in playback data */
 		err = prepare_outbound_urb(ep, ctx, in_stream_lock);
@@ -501,7 +553,7 @@ int snd_usb_queue_pending_output_urbs(struct snd_usb_endpoint *ep,
 			}
 
 			if (!in_stream_lock)
-				notify_xrun(ep);
+				notify_xrun(ep, SND_USB_XRUN_PREPARE);
 			return -EPIPE;
 		}
 
@@ -515,7 +567,7 @@ int snd_usb_queue_pending_output_urbs(struct snd_usb_endpoint *ep,
 					      "Unable to submit urb #%d: %d at %s\n",
 					      ctx->index, err, __func__);
 				if (!in_stream_lock)
-					notify_xrun(ep);
+					notify_xrun(ep, SND_USB_XRUN_SUBMIT);
 			}
 			return -EPIPE;
 		}
@@ -527,12 +579,20 @@ int snd_usb_queue_pending_output_urbs(struct snd_usb_endpoint *ep,
 	return 0;
 }
 
+/* drop the submitted count of a retired URB and wake up the stop waiter */
+static inline void urb_retired(struct snd_usb_endpoint *ep)
+{
+	if (atomic_dec_and_test(&ep->submitted_urbs))
+		wake_up(&ep->drain_wait);
+}
+
 /*
- * complete callback for urbs
+ * process a completed urb; called from snd_complete_urb() either directly
+ * or via the endpoint's completion worker
  */
-static void snd_complete_urb(struct urb *urb)
+static void handle_complete_urb(struct snd_urb_ctx *ctx)
 {
-	struct snd_urb_ctx *ctx = urb->context;
+	struct urb *urb = ctx->urb;
 	struct snd_usb_endpoint *ep = ctx->ep;
 	int err;
 
@@ -562,7 +622,7 @@ static void snd_complete_urb(struct urb *urb)
 			push_back_to_ready_list(ep, ctx);
 			clear_bit(ctx->index, &ep->active_mask);
 			snd_usb_queue_pending_output_urbs(ep, false);
-			atomic_dec(&ep->submitted_urbs); /* decrement at last */
+			urb_retired(ep); /* decrement at last */
 			return;
 		}
 
@@ -589,12 +649,214 @@ static void snd_complete_urb(struct urb *urb)
 
 	if (!atomic_read(&ep->chip->shutdown)) {
 		usb_audio_err(ep->chip, "cannot submit urb (err = %d)\n", err);
-		notify_xrun(ep);
+		notify_xrun(ep, SND_USB_XRUN_SUBMIT);
 	}
 
 exit_clear:
 	clear_bit(ctx->index, &ep->active_mask);
-	atomic_dec(&ep->submitted_urbs);
+	urb_retired(ep);
+}
+
+/* publish the endpoint state for lockless readers of ep->snap */
+static void update_ep_snapshot(struct snd_usb_endpoint *ep, ktime_t now)
+{
+	struct snd_usb_substream *data_subs = READ_ONCE(ep->data_subs);
+	struct snd_usb_ep_snapshot *snap = &ep->snap;
+
+	write_seqcount_begin(&ep->snap_seq);
+	snap->size = sizeof(*snap);
+	snap->ep_num = ep->ep_num;
+	snap->running = ep_state_running(ep);
+	snap->freqm = ep->freqm;
+	snap->urbs = ep->stat_urbs;
+	snap->bytes = ep->stat_bytes;
+	snap->xruns = READ_ONCE(ep->stat_xruns);
+	snap->submitted = atomic_read(&ep->submitted_urbs);
+	snap->queue_depth = READ_ONCE(ep->next_packet_queued);
+	snap->inflight_bytes = data_subs ? READ_ONCE(data_subs->inflight_bytes) : 0;
+	snap->timestamp_ns = ktime_to_ns(now);
+	write_seqcount_end(&ep->snap_seq);
+}
+
+/*
+ * Periodic bandwidth of @ep in bytes per second: @reserved is what the host
+ * schedules for the selected altsetting, @used the nominal stream rate.
+ * Both are zero while the altsetting isn't active.  Call with chip->mutex.
+ */
+void snd_usb_endpoint_get_bandwidth(struct snd_usb_endpoint *ep,
+				    unsigned int *reserved, unsigned int *used)
+{
+	struct usb_device *dev = ep->chip->dev;
+	struct usb_host_endpoint *hep;
+	unsigned int ips;
+
+	*reserved = *used = 0;
+	if (!ep->iface_ref || !ep->altsetting ||
+	    ep->iface_ref->altset != ep->altsetting)
+		return;
+	hep = usb_pipe_endpoint(dev, ep->pipe);
+	if (!hep)
+		return;
+
+	/* service intervals per second */
+	ips = snd_usb_get_speed(dev) == USB_SPEED_FULL ? 1000 : 8000;
+	ips >>= clamp_t(unsigned int, hep->desc.bInterval, 1, 16) - 1;
+
+	*reserved = usb_endpoint_maxp(&hep->desc) *
+		usb_endpoint_maxp_mult(&hep->desc) * ips;
+	if (ep->type == SND_USB_ENDPOINT_TYPE_SYNC)
+		*used = min(4u, ep->syncmaxsize) * ips;
+	else
+		*used = ep->cur_rate * ep->cur_frame_bytes +
+			(has_tx_length_quirk(ep->chip) ? 4 * ep->pps : 0);
+}
+
+/* copy a consistent snapshot of the endpoint state */
+void snd_usb_endpoint_get_snapshot(struct snd_usb_endpoint *ep,
+				   struct snd_usb_ep_snapshot *snap)
+{
+	unsigned int seq;
+
+	do {
+		seq = read_seqcount_begin(&ep->snap_seq);
+		*snap = ep->snap;
+	} while (read_seqcount_retry(&ep->snap_seq, seq));
+}
+
+/* append the completed URB to the endpoint history */
+static void record_ep_event(struct snd_usb_endpoint *ep,
+			    struct snd_urb_ctx *ctx, ktime_t now)
+{
+	struct snd_usb_ep_event *ev;
+	u64 ns = ktime_to_ns(now);
+	u64 urb_ns = 0;
+	unsigned long flags;
+
+	if (ep->type == SND_USB_ENDPOINT_TYPE_DATA && ep->pps)
+		urb_ns = div_u64((u64)ctx->packets * NSEC_PER_SEC, ep->pps);
+
+	spin_lock_irqsave(&ep->hist_lock, flags);
+	ev = &ep->hist[ep->hist_pos++ % EP_EVENT_HISTORY];
+	ev->time_ns = ns;
+	ev->status = ctx->urb->status;
+	ev->length = ctx->urb->actual_length;
+	ev->index = ctx->index;
+	ev->submitted = atomic_read(&ep->submitted_urbs);
+	ev->queued = ep->next_packet_queued;
+	ev->late = urb_ns && ep->last_complete_ns &&
+		ns - ep->last_complete_ns > 2 * urb_ns;
+	spin_unlock_irqrestore(&ep->hist_lock, flags);
+	ep->last_complete_ns = ns;
+}
+
+static void account_complete_urb(struct snd_urb_ctx *ctx)
+{
+	struct snd_usb_endpoint *ep = ctx->ep;
+	ktime_t start = ktime_get();
+	ktime_t end;
+	unsigned int ns;
+
+	/* actual_length is reset when the URB gets resubmitted */
+	record_ep_event(ep, ctx, start);
+	if (!ctx->urb->status) {
+		ep->stat_urbs++;
+		ep->stat_bytes += ctx->urb->actual_length;
+	}
+
+	ep->complete_last_cpu = raw_smp_processor_id();
+	handle_complete_urb(ctx);
+	end = ktime_get();
+	ns = ktime_to_ns(ktime_sub(end, start));
+	ep->complete_count++;
+	ep->complete_total_ns += ns;
+	if (ns > ep->complete_max_ns)
+		ep->complete_max_ns = ns;
+
+	update_ep_snapshot(ep, end);
+}
+
+/*
+ * deferred completion worker; the URBs are handled in the order of their
+ * completion, and the work item never runs concurrently with itself
+ */
+static void snd_complete_urb_work(struct work_struct *work)
+{
+	struct snd_usb_endpoint *ep =
+		container_of(work, struct snd_usb_endpoint, complete_work);
+	struct snd_urb_ctx *ctx;
+	unsigned long flags;
+
+	for (;;) {
+		spin_lock_irqsave(&ep->lock, flags);
+		ctx = list_first_entry_or_null(&ep->complete_pending,
+					       struct snd_urb_ctx,
+					       complete_list);
+		if (ctx)
+			list_del(&ctx->complete_list);
+		spin_unlock_irqrestore(&ep->lock, flags);
+		if (!ctx)
+			break;
+
+		/* the handlers expect the BH context of the HCD giveback */
+		local_bh_disable();
+		account_complete_urb(ctx);
+		local_bh_enable();
+	}
+}
+
+/*
+ * complete callback for urbs
+ */
+static void snd_complete_urb(struct urb *urb)
+{
+	struct snd_urb_ctx *ctx = urb->context;
+	struct snd_usb_endpoint *ep = ctx->ep;
+	unsigned long flags;
+
+	if (ep->complete_cpu >= 0) {
+		spin_lock_irqsave(&ep->lock, flags);
+		list_add_tail(&ctx->complete_list, &ep->complete_pending);
+		spin_unlock_irqrestore(&ep->lock, flags);
+		queue_work_on(ep->complete_cpu, system_highpri_wq,
+			      &ep->complete_work);
+		return;
+	}
+
+	account_complete_urb(ctx);
+}
+
+/*
+ * The ref tables are caches indexed by the low byte of the ID; the lists
+ * stay authoritative for IDs that alias in the table.
+ */
+static struct snd_usb_iface_ref *
+iface_ref_lookup(struct snd_usb_audio *chip, int iface)
+{
+	struct snd_usb_iface_ref *ip;
+
+	ip = chip->iface_ref_table[iface & 0xff];
+	if (ip && ip->iface == iface)
+		return ip;
+
+	list_for_each_entry(ip, &chip->iface_ref_list, list)
+		if (ip->iface == iface)
+			return ip;
+	return NULL;
+}
+
+static struct snd_usb_clock_ref *
+clock_ref_lookup(struct snd_usb_audio *chip, int clock)
+{
+	struct snd_usb_clock_ref *ref;
+
+	ref = chip->clock_ref_table[clock & 0xff];
+	if (ref && ref->clock == clock)
+		return ref;
+
+	list_for_each_entry(ref, &chip->clock_ref_list, list)
+		if (ref->clock == clock)
+			return ref;
+	return NULL;
 }
 
 /*
@@ -607,15 +869,17 @@ iface_ref_find(struct snd_usb_audio *chip, int iface)
 {
 	struct snd_usb_iface_ref *ip;
 
-	list_for_each_entry(ip, &chip->iface_ref_list, list)
-		if (ip->iface == iface)
-			return ip;
+	ip = iface_ref_lookup(chip, iface);
+	if (ip)
+		return ip;
 
 	ip = kzalloc(sizeof(*ip), GFP_KERNEL);
 	if (!ip)
 		return NULL;
 	ip->iface = iface;
 	list_add_tail(&ip->list, &chip->iface_ref_list);
+	if (!chip->iface_ref_table[iface & 0xff])
+		chip->iface_ref_table[iface & 0xff] = ip;
 	return ip;
 }
 
@@ -625,9 +889,9 @@ clock_ref_find(struct snd_usb_audio *chip, int clock)
 {
 	struct snd_usb_clock_ref *ref;
 
-	list_for_each_entry(ref, &chip->clock_ref_list, list)
-		if (ref->clock == clock)
-			return ref;
+	ref = clock_ref_lookup(chip, clock);
+	if (ref)
+		return ref;
 
 	ref = kzalloc(sizeof(*ref), GFP_KERNEL);
 	if (!ref)
@@ -635,6 +899,8 @@ clock_ref_find(struct snd_usb_audio *chip, int clock)
 	ref->clock = clock;
 	atomic_set(&ref->locked, 0);
 	list_add_tail(&ref->list, &chip->clock_ref_list);
+	if (!chip->clock_ref_table[clock & 0xff])
+		chip->clock_ref_table[clock & 0xff] = ref;
 	return ref;
 }
 
@@ -647,10 +913,9 @@ snd_usb_get_endpoint(struct snd_usb_audio *chip, int ep_num)
 {
 	struct snd_usb_endpoint *ep;
 
-	list_for_each_entry(ep, &chip->ep_list, list) {
-		if (ep->ep_num == ep_num)
-			return ep;
-	}
+	ep = chip->ep_table[ep_table_index(ep_num)];
+	if (ep && ep->ep_num == ep_num)
+		return ep;
 
 	return NULL;
 }
@@ -698,6 +963,12 @@ int snd_usb_add_endpoint(struct snd_usb_audio *chip, int ep_num, int type)
 	ep->ep_num = ep_num;
 	INIT_LIST_HEAD(&ep->ready_playback_urbs);
 	atomic_set(&ep->submitted_urbs, 0);
+	init_waitqueue_head(&ep->drain_wait);
+	ep->complete_cpu = -1;
+	INIT_WORK(&ep->complete_work, snd_complete_urb_work);
+	INIT_LIST_HEAD(&ep->complete_pending);
+	seqcount_init(&ep->snap_seq);
+	spin_lock_init(&ep->hist_lock);
 
 	is_playback = ((ep_num & USB_ENDPOINT_DIR_MASK) == USB_DIR_OUT);
 	ep_num &= USB_ENDPOINT_NUMBER_MASK;
@@ -707,6 +978,7 @@ int snd_usb_add_endpoint(struct snd_usb_audio *chip, int ep_num, int type)
 		ep->pipe = usb_rcvisocpipe(chip->dev, ep_num);
 
 	list_add_tail(&ep->list, &chip->ep_list);
+	chip->ep_table[ep_table_index(ep->ep_num)] = ep;
 	return 0;
 }
 
@@ -933,7 +1205,7 @@ static int endpoint_set_interface(struct snd_usb_audio *chip,
 	}
 
 	if (chip->quirk_flags & QUIRK_FLAG_IFACE_DELAY)
-		msleep(50);
+		snd_usb_clock_settle(chip, set ? ep->cur_audiofmt : NULL);
 	ep->iface_ref->altset = altset;
 	return 0;
 }
@@ -970,10 +1242,16 @@ void snd_usb_endpoint_close(struct snd_usb_audio *chip,
 	mutex_unlock(&chip->mutex);
 }
 
-/* Prepare for suspening EP, called from the main suspend handler */
-void snd_usb_endpoint_suspend(struct snd_usb_endpoint *ep)
+/* Prepare for suspening EP, called from the main suspend handler;
+ * devices flagged to retain their altset and clock setup over a runtime
+ * suspend keep the cached state, all others are set up again
+ */
+void snd_usb_endpoint_suspend(struct snd_usb_endpoint *ep, bool autosuspend)
 {
 	ep->need_prepare = true;
+	if (autosuspend &&
+	    (ep->chip->quirk_flags & QUIRK_FLAG_KEEP_IFACE_ON_AUTOSUSPEND))
+		return;
 	if (ep->iface_ref)
 		ep->iface_ref->need_setup = true;
 	if (ep->clock_ref)
@@ -985,20 +1263,16 @@ void snd_usb_endpoint_suspend(struct snd_usb_endpoint *ep)
  */
 static int wait_clear_urbs(struct snd_usb_endpoint *ep)
 {
-	unsigned long end_time = jiffies + msecs_to_jiffies(1000);
 	int alive;
 
 	if (atomic_read(&ep->state) != EP_STATE_STOPPING)
 		return 0;
 
-	do {
-		alive = atomic_read(&ep->submitted_urbs);
-		if (!alive)
-			break;
-
-		schedule_timeout_uninterruptible(1);
-	} while (time_before(jiffies, end_time));
+	/* the last retiring URB wakes us up in snd_complete_urb() */
+	wait_event_timeout(ep->drain_wait, !atomic_read(&ep->submitted_urbs),
+			   msecs_to_jiffies(1000));
 
+	alive = atomic_read(&ep->submitted_urbs);
 	if (alive)
 		usb_audio_err(ep->chip,
 			"timeout: still %d active urbs on EP #%x\n",
@@ -1058,6 +1332,97 @@ static int stop_urbs(struct snd_usb_endpoint *ep, bool force, bool keep_pending)
 	return 0;
 }
 
+static void release_arena(struct snd_usb_endpoint *ep)
+{
+	if (!ep->arena)
+		return;
+	usb_free_coherent(ep->chip->dev, ep->arena_size,
+			  ep->arena, ep->arena_dma);
+	ep->arena = NULL;
+	ep->arena_size = 0;
+}
+
+/*
+ * Make sure the endpoint's arena holds at least @size bytes.  The arena is
+ * only reallocated when it is too small, and then sized for @reserve bytes,
+ * so that later hw_params with up to that much buffer space reuse it.  If
+ * the reserve can't be had in one block, only @size is allocated.
+ */
+static int get_arena(struct snd_usb_endpoint *ep, unsigned int size,
+		     unsigned int reserve)
+{
+	if (ep->arena && ep->arena_size >= size) {
+		ep->arena_reuses++;
+		return 0;
+	}
+
+	release_arena(ep);
+	reserve = PAGE_ALIGN(max(size, reserve));
+	ep->arena = usb_alloc_coherent(ep->chip->dev, reserve,
+				       GFP_KERNEL | __GFP_NOWARN,
+				       &ep->arena_dma);
+	if (!ep->arena && reserve > PAGE_ALIGN(size)) {
+		/* fragmented memory; settle for what this hw_params needs */
+		reserve = PAGE_ALIGN(size);
+		ep->arena = usb_alloc_coherent(ep->chip->dev, reserve,
+					       GFP_KERNEL, &ep->arena_dma);
+	}
+	if (!ep->arena)
+		return -ENOMEM;
+	ep->arena_size = reserve;
+	ep->arena_allocs++;
+	usb_audio_dbg(ep->chip, "EP 0x%x: allocated %u bytes arena\n",
+		      ep->ep_num, reserve);
+	return 0;
+}
+
+/*
+ * Allocate the packet size tables of a playback data endpoint: a row of
+ * @packs sizes per URB followed by one per slot of the implicit feedback
+ * ring, all in a single block so that the completion path stays within a
+ * few cache lines.  The ring keeps MAX_URBS slots regardless of our own
+ * URB count, as the capture source may run more URBs than we do.  Capture
+ * endpoints don't need any of this.
+ */
+static int alloc_packet_meta(struct snd_usb_endpoint *ep, unsigned int packs)
+{
+	unsigned int slots = 0;
+	u16 *sizes;
+	int i;
+
+	if (snd_usb_endpoint_implicit_feedback_sink(ep))
+		slots = MAX_URBS;
+
+	ep->packet_meta = kzalloc(slots * sizeof(*ep->next_packet) +
+				  (ep->nurbs + slots) * packs * sizeof(u16),
+				  GFP_KERNEL);
+	if (!ep->packet_meta)
+		return -ENOMEM;
+
+	ep->next_packet = ep->packet_meta;
+	sizes = (u16 *)(ep->next_packet + slots);
+	for (i = 0; i < ep->nurbs; i++, sizes += packs)
+		ep->urb[i].packet_size = sizes;
+	for (i = 0; i < slots; i++, sizes += packs)
+		ep->next_packet[i].packet_size = sizes;
+	ep->next_packet_slots = slots;
+	ep->next_packet_packs = packs;
+	return 0;
+}
+
+static void release_packet_meta(struct snd_usb_endpoint *ep)
+{
+	int i;
+
+	for (i = 0; i < ep->nurbs; i++)
+		ep->urb[i].packet_size = NULL;
+	kfree(ep->packet_meta);
+	ep->packet_meta = NULL;
+	ep->next_packet = NULL;
+	ep->next_packet_slots = 0;
+	ep->next_packet_packs = 0;
+}
+
 /*
  * release an endpoint's urbs
  */
@@ -1074,14 +1439,16 @@ static int release_urbs(struct snd_usb_endpoint *ep, bool force)
 		return err;
 
 	wait_clear_urbs(ep);
+	flush_work(&ep->complete_work);
 
 	for (i = 0; i < ep->nurbs; i++)
 		release_urb_ctx(&ep->urb[i]);
+	release_packet_meta(ep);
 
-	usb_free_coherent(ep->chip->dev, SYNC_URBS * 4,
-			  ep->syncbuf, ep->sync_dma);
+	/* keep the arena for the next hw_params unless tearing down */
+	if (force)
+		release_arena(ep);
 
-	ep->syncbuf = NULL;
 	ep->nurbs = 0;
 	return 0;
 }
@@ -1094,7 +1461,7 @@ static int data_ep_set_params(struct snd_usb_endpoint *ep)
 	struct snd_usb_audio *chip = ep->chip;
 	unsigned int maxsize, minsize, packs_per_ms, max_packs_per_urb;
 	unsigned int max_packs_per_period, urbs_per_period, urb_packs;
-	unsigned int max_urbs, i;
+	unsigned int max_urbs, i, stride;
 	const struct audioformat *fmt = ep->cur_audiofmt;
 	int frame_bits = ep->cur_frame_bytes * 8;
 	int tx_length_quirk = (has_tx_length_quirk(chip) &&
@@ -1179,6 +1546,8 @@ static int data_ep_set_params(struct snd_usb_endpoint *ep)
 		max_packs_per_urb = min(max_packs_per_urb,
 					1U << ep->sync_source->syncinterval);
 	max_packs_per_urb = max(1u, max_packs_per_urb >> ep->datainterval);
+	if (chip->tune.max_packs)
+		max_packs_per_urb = min(max_packs_per_urb, chip->tune.max_packs);
 
 	/*
 	 * Capture endpoints need to use small URBs because there's no way
@@ -1230,6 +1599,27 @@ static int data_ep_set_params(struct snd_usb_endpoint *ep)
 		ep->nurbs = min(max_urbs, urbs_per_period * ep->cur_buffer_periods);
 	}
 
+	if (chip->tune.max_urbs)
+		ep->nurbs = min(ep->nurbs, chip->tune.max_urbs);
+
+	/*
+	 * The URB buffers are cache-line aligned slices of one arena, which
+	 * is sized for MAX_URBS of them so that a different URB count in a
+	 * later hw_params doesn't need a new one.
+	 */
+	stride = ALIGN(maxsize * urb_packs, L1_CACHE_BYTES);
+	if (get_arena(ep, ep->nurbs * stride, MAX_URBS * stride) < 0) {
+		ep->nurbs = 0;
+		return -ENOMEM;
+	}
+
+	if (usb_pipeout(ep->pipe) &&
+	    alloc_packet_meta(ep, urb_packs +
+			      (fmt->fmt_type == UAC_FORMAT_TYPE_II)) < 0) {
+		ep->nurbs = 0;
+		return -ENOMEM;
+	}
+
 	/* allocate and initialize data urbs */
 	for (i = 0; i < ep->nurbs; i++) {
 		struct snd_urb_ctx *u = &ep->urb[i];
@@ -1244,11 +1634,8 @@ static int data_ep_set_params(struct snd_usb_endpoint *ep)
 		if (!u->urb)
 			goto out_of_memory;
 
-		u->urb->transfer_buffer =
-			usb_alloc_coherent(chip->dev, u->buffer_size,
-					   GFP_KERNEL, &u->urb->transfer_dma);
-		if (!u->urb->transfer_buffer)
-			goto out_of_memory;
+		u->urb->transfer_buffer = ep->arena + i * stride;
+		u->urb->transfer_dma = ep->arena_dma + i * stride;
 		u->urb->pipe = ep->pipe;
 		u->urb->transfer_flags = URB_NO_TRANSFER_DMA_MAP;
 		u->urb->interval = 1 << ep->datainterval;
@@ -1264,37 +1651,66 @@ out_of_memory:
 	return -ENOMEM;
 }
 
+/*
+ * Number of feedback packets gathered in one sync URB.  Only inbound
+ * feedback is batched; in auto mode, high speed devices reporting more
+ * often than once per frame get a single completion per ms.
+ */
+static unsigned int sync_ep_batch(struct snd_usb_endpoint *ep)
+{
+	struct snd_usb_audio *chip = ep->chip;
+	int batch = chip->tune.sync_batch;
+
+	if (!usb_pipein(ep->pipe) || !batch)
+		return 1;
+	if (batch < 0) {
+		if (snd_usb_get_speed(chip->dev) == USB_SPEED_FULL ||
+		    ep->syncinterval >= 3)
+			return 1;
+		batch = 8 >> ep->syncinterval;
+	}
+	return min(batch, MAX_SYNC_PACKS);
+}
+
 /*
  * configure a sync endpoint
  */
 static int sync_ep_set_params(struct snd_usb_endpoint *ep)
 {
 	struct snd_usb_audio *chip = ep->chip;
+	unsigned int packs = sync_ep_batch(ep);
+	unsigned int stride = ALIGN(4 * packs, L1_CACHE_BYTES);
 	int i;
 
 	usb_audio_dbg(chip, "Setting params for sync EP 0x%x, pipe 0x%x\n",
 		      ep->ep_num, ep->pipe);
 
-	ep->syncbuf = usb_alloc_coherent(chip->dev, SYNC_URBS * 4,
-					 GFP_KERNEL, &ep->sync_dma);
-	if (!ep->syncbuf)
+	/*
+	 * Fewer URBs when batching, but never less than two so one is always
+	 * queued.  This trades latency for completions: nurbs * packs
+	 * intervals are in flight (up to 2 * 8 against 4 * 1 unbatched), and
+	 * a feedback value reaches freqm up to packs - 1 intervals late.
+	 */
+	ep->nurbs = max(2U, DIV_ROUND_UP(SYNC_URBS, packs));
+	if (get_arena(ep, ep->nurbs * stride, 0) < 0) {
+		ep->nurbs = 0;
 		return -ENOMEM;
+	}
 
-	ep->nurbs = SYNC_URBS;
-	for (i = 0; i < SYNC_URBS; i++) {
+	for (i = 0; i < ep->nurbs; i++) {
 		struct snd_urb_ctx *u = &ep->urb[i];
 		u->index = i;
 		u->ep = ep;
-		u->packets = 1;
-		u->urb = usb_alloc_urb(1, GFP_KERNEL);
+		u->packets = packs;
+		u->urb = usb_alloc_urb(packs, GFP_KERNEL);
 		if (!u->urb)
 			goto out_of_memory;
-		u->urb->transfer_buffer = ep->syncbuf + i * 4;
-		u->urb->transfer_dma = ep->sync_dma + i * 4;
-		u->urb->transfer_buffer_length = 4;
+		u->urb->transfer_buffer = ep->arena + i * stride;
+		u->urb->transfer_dma = ep->arena_dma + i * stride;
+		u->urb->transfer_buffer_length = 4 * packs;
 		u->urb->pipe = ep->pipe;
 		u->urb->transfer_flags = URB_NO_TRANSFER_DMA_MAP;
-		u->urb->number_of_packets = 1;
+		u->urb->number_of_packets = packs;
 		u->urb->interval = 1 << ep->syncinterval;
 		u->urb->context = u;
 		u->urb->complete = snd_complete_urb;
@@ -1375,6 +1791,15 @@ int snd_usb_endpoint_set_params(struct snd_usb_audio *chip,
 
 	ep->phase = 0;
 
+	ep->complete_cpu = chip->tune.complete_cpu;
+	if (ep->complete_cpu >= 0 && !cpu_online(ep->complete_cpu))
+		ep->complete_cpu = -1;
+	ep->complete_count = 0;
+	ep->complete_total_ns = 0;
+	ep->complete_max_ns = 0;
+	ep->fb_values = 0;
+	ep->fb_rejects = 0;
+
 	switch (ep->type) {
 	case  SND_USB_ENDPOINT_TYPE_DATA:
 		err = data_ep_set_params(ep);
@@ -1523,12 +1948,9 @@ int snd_usb_endpoint_get_clock_rate(struct snd_usb_audio *chip, int clock)
 	if (!clock)
 		return 0;
 	mutex_lock(&chip->mutex);
-	list_for_each_entry(ref, &chip->clock_ref_list, list) {
-		if (ref->clock == clock) {
-			rate = ref->rate;
-			break;
-		}
-	}
+	ref = clock_ref_lookup(chip, clock);
+	if (ref)
+		rate = ref->rate;
 	mutex_unlock(&chip->mutex);
 	return rate;
 }
@@ -1573,6 +1995,7 @@ int snd_usb_endpoint_start(struct snd_usb_endpoint *ep)
 	ep->unlink_mask = 0;
 	ep->phase = 0;
 	ep->sample_accum = 0;
+	ep->last_complete_ns = 0;
 
 	snd_usb_endpoint_start_quirk(ep);
 
@@ -1629,6 +2052,7 @@ int snd_usb_endpoint_start(struct snd_usb_endpoint *ep)
 	}
 
 	if (!i) {
+		record_xrun(ep, SND_USB_XRUN_START);
 		usb_audio_dbg(ep->chip, "XRUN at starting EP 0x%x\n",
 			      ep->ep_num);
 		goto __error;
@@ -1719,14 +2143,108 @@ void snd_usb_endpoint_free_all(struct snd_usb_audio *chip)
 	struct snd_usb_iface_ref *ip, *in;
 	struct snd_usb_clock_ref *cp, *cn;
 
-	list_for_each_entry_safe(ep, en, &chip->ep_list, list)
+	list_for_each_entry_safe(ep, en, &chip->ep_list, list) {
+		cancel_work_sync(&ep->complete_work);
+		release_arena(ep);
+		kfree(ep->packet_meta);
 		kfree(ep);
+	}
 
 	list_for_each_entry_safe(ip, in, &chip->iface_ref_list, list)
 		kfree(ip);
 
 	list_for_each_entry_safe(cp, cn, &chip->clock_ref_list, list)
 		kfree(cp);
+
+	memset(chip->ep_table, 0, sizeof(chip->ep_table));
+	memset(chip->iface_ref_table, 0, sizeof(chip->iface_ref_table));
+	memset(chip->clock_ref_table, 0, sizeof(chip->clock_ref_table));
+}
+
+/*
+ * Apply one feedback value of @len bytes from @sender to the data endpoint.
+ */
+static void handle_feedback(struct snd_usb_endpoint *ep,
+			    struct snd_usb_endpoint *sender,
+			    const u8 *buf, unsigned int len)
+{
+	int shift;
+	unsigned int f;
+	unsigned long flags;
+
+	/*
+	 * process after playback sync complete
+	 *
+	 * Full speed devices report feedback values in 10.14 format as samples
+	 * per frame, high speed devices in 16.16 format as samples per
+	 * microframe.
+	 *
+	 * Because the Audio Class 1 spec was written before USB 2.0, many high
+	 * speed devices use a wrong interpretation, some others use an
+	 * entirely different format.
+	 *
+	 * Therefore, we cannot predict what format any particular device uses
+	 * and must detect it automatically.
+	 */
+
+	f = le32_to_cpup((const __le32 *)buf);
+	if (len == 3)
+		f &= 0x00ffffff;
+	else
+		f &= 0x0fffffff;
+
+	if (f == 0)
+		return;
+	ep->fb_values++;
+
+	if (unlikely(sender->tenor_fb_quirk)) {
+		/*
+		 * Devices based on Tenor 8802 chipsets (TEAC UD-H01
+		 * and others) sometimes change the feedback value
+		 * by +/- 0x1.0000.
+		 */
+		if (f < ep->freqn - 0x8000)
+			f += 0xf000;
+		else if (f > ep->freqn + 0x8000)
+			f -= 0xf000;
+	} else if (unlikely(ep->freqshift == INT_MIN)) {
+		/*
+		 * The first time we see a feedback value, determine its format
+		 * by shifting it left or right until it matches the nominal
+		 * frequency value.  This assumes that the feedback does not
+		 * differ from the nominal value more than +50% or -25%.
+		 */
+		shift = 0;
+		while (f < ep->freqn - ep->freqn / 4) {
+			f <<= 1;
+			shift++;
+		}
+		while (f > ep->freqn + ep->freqn / 2) {
+			f >>= 1;
+			shift--;
+		}
+		ep->freqshift = shift;
+	} else if (ep->freqshift >= 0)
+		f <<= ep->freqshift;
+	else
+		f >>= -ep->freqshift;
+
+	if (likely(f >= ep->freqn - ep->freqn / 8 && f <= ep->freqmax)) {
+		/*
+		 * If the frequency looks valid, set it.
+		 * This value is referred to in prepare_playback_urb().
+		 */
+		spin_lock_irqsave(&ep->lock, flags);
+		ep->freqm = f;
+		spin_unlock_irqrestore(&ep->lock, flags);
+	} else {
+		/*
+		 * Out of range; maybe the shift value is wrong.
+		 * Reset it so that we autodetect again the next time.
+		 */
+		ep->freqshift = INT_MIN;
+		ep->fb_rejects++;
+	}
 }
 
 /*
@@ -1743,9 +2261,8 @@ static void snd_usb_handle_sync_urb(struct snd_usb_endpoint *ep,
 				    struct snd_usb_endpoint *sender,
 				    const struct urb *urb)
 {
-	int shift;
-	unsigned int f;
 	unsigned long flags;
+	int i;
 
 	snd_BUG_ON(ep == sender);
 
@@ -1759,7 +2276,8 @@ static void snd_usb_handle_sync_urb(struct snd_usb_endpoint *ep,
 	    atomic_read(&ep->running)) {
 
 		/* implicit feedback case */
-		int i, bytes = 0;
+		unsigned int dropped;
+		int bytes = 0;
 		struct snd_urb_ctx *in_ctx;
 		struct snd_usb_packet_info *out_packet;
 
@@ -1778,12 +2296,24 @@ static void snd_usb_handle_sync_urb(struct snd_usb_endpoint *ep,
 			return;
 
 		spin_lock_irqsave(&ep->lock, flags);
-		if (ep->next_packet_queued >= ARRAY_SIZE(ep->next_packet)) {
+		if (ep->next_packet_queued >= ep->next_packet_slots &&
+		    ep->chip->tune.elastic_fb && ep->next_packet_queued > 1) {
+			dropped = next_packet_fifo_merge(ep);
+			if (dropped) {
+				spin_unlock_irqrestore(&ep->lock, flags);
+				usb_audio_err(ep->chip,
+					      "next package FIFO overflow EP 0x%x, %u frames lost\n",
+					      ep->ep_num, dropped);
+				notify_xrun(ep, SND_USB_XRUN_FIFO);
+				return;
+			}
+		}
+		if (ep->next_packet_queued >= ep->next_packet_slots) {
 			spin_unlock_irqrestore(&ep->lock, flags);
 			usb_audio_err(ep->chip,
 				      "next package FIFO overflow EP 0x%x\n",
 				      ep->ep_num);
-			notify_xrun(ep);
+			notify_xrun(ep, SND_USB_XRUN_FIFO);
 			return;
 		}
 
@@ -1799,8 +2329,9 @@ static void snd_usb_handle_sync_urb(struct snd_usb_endpoint *ep,
 		 * fed-back endpoint and the synchronizing endpoint.
 		 */
 
-		out_packet->packets = in_ctx->packets;
-		for (i = 0; i < in_ctx->packets; i++) {
+		out_packet->packets = min_t(unsigned int, in_ctx->packets,
+					    ep->next_packet_packs);
+		for (i = 0; i < out_packet->packets; i++) {
 			if (urb->iso_frame_desc[i].status == 0)
 				out_packet->packet_size[i] =
 					urb->iso_frame_desc[i].actual_length / sender->stride;
@@ -1814,80 +2345,16 @@ static void snd_usb_handle_sync_urb(struct snd_usb_endpoint *ep,
 		return;
 	}
 
-	/*
-	 * process after playback sync complete
-	 *
-	 * Full speed devices report feedback values in 10.14 format as samples
-	 * per frame, high speed devices in 16.16 format as samples per
-	 * microframe.
-	 *
-	 * Because the Audio Class 1 spec was written before USB 2.0, many high
-	 * speed devices use a wrong interpretation, some others use an
-	 * entirely different format.
-	 *
-	 * Therefore, we cannot predict what format any particular device uses
-	 * and must detect it automatically.
-	 */
-
-	if (urb->iso_frame_desc[0].status != 0 ||
-	    urb->iso_frame_desc[0].actual_length < 3)
-		return;
-
-	f = le32_to_cpup(urb->transfer_buffer);
-	if (urb->iso_frame_desc[0].actual_length == 3)
-		f &= 0x00ffffff;
-	else
-		f &= 0x0fffffff;
-
-	if (f == 0)
-		return;
-
-	if (unlikely(sender->tenor_fb_quirk)) {
-		/*
-		 * Devices based on Tenor 8802 chipsets (TEAC UD-H01
-		 * and others) sometimes change the feedback value
-		 * by +/- 0x1.0000.
-		 */
-		if (f < ep->freqn - 0x8000)
-			f += 0xf000;
-		else if (f > ep->freqn + 0x8000)
-			f -= 0xf000;
-	} else if (unlikely(ep->freqshift == INT_MIN)) {
-		/*
-		 * The first time we see a feedback value, determine its format
-		 * by shifting it left or right until it matches the nominal
-		 * frequency value.  This assumes that the feedback does not
-		 * differ from the nominal value more than +50% or -25%.
-		 */
-		shift = 0;
-		while (f < ep->freqn - ep->freqn / 4) {
-			f <<= 1;
-			shift++;
-		}
-		while (f > ep->freqn + ep->freqn / 2) {
-			f >>= 1;
-			shift--;
-		}
-		ep->freqshift = shift;
-	} else if (ep->freqshift >= 0)
-		f <<= ep->freqshift;
-	else
-		f >>= -ep->freqshift;
+	/* a batched sync URB carries several feedback values, in order */
+	for (i = 0; i < urb->number_of_packets; i++) {
+		const struct usb_iso_packet_descriptor *desc =
+			&urb->iso_frame_desc[i];
 
-	if (likely(f >= ep->freqn - ep->freqn / 8 && f <= ep->freqmax)) {
-		/*
-		 * If the frequency looks valid, set it.
-		 * This value is referred to in prepare_playback_urb().
-		 */
-		spin_lock_irqsave(&ep->lock, flags);
-		ep->freqm = f;
-		spin_unlock_irqrestore(&ep->lock, flags);
-	} else {
-		/*
-		 * Out of range; maybe the shift value is wrong.
-		 * Reset it so that we autodetect again the next time.
-		 */
-		ep->freqshift = INT_MIN;
+		if (desc->status != 0 || desc->actual_length < 3)
+			continue;
+		handle_feedback(ep, sender,
+				urb->transfer_buffer + desc->offset,
+				desc->actual_length);
 	}
 }
 
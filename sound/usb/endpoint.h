@@ -5,6 +5,11 @@
 #define SND_USB_ENDPOINT_TYPE_DATA     0
 #define SND_USB_ENDPOINT_TYPE_SYNC     1
 
+/* index into chip->ep_table from the endpoint number and direction */
+#define ep_table_index(ep_num) \
+	(((ep_num) & USB_ENDPOINT_NUMBER_MASK) | \
+	 (((ep_num) & USB_ENDPOINT_DIR_MASK) ? 0x10 : 0))
+
 struct snd_usb_endpoint *snd_usb_get_endpoint(struct snd_usb_audio *chip,
 					      int ep_num);
 
@@ -43,9 +48,13 @@ void snd_usb_endpoint_set_callback(struct snd_usb_endpoint *ep,
 int snd_usb_endpoint_start(struct snd_usb_endpoint *ep);
 void snd_usb_endpoint_stop(struct snd_usb_endpoint *ep, bool keep_pending);
 void snd_usb_endpoint_sync_pending_stop(struct snd_usb_endpoint *ep);
-void snd_usb_endpoint_suspend(struct snd_usb_endpoint *ep);
+void snd_usb_endpoint_suspend(struct snd_usb_endpoint *ep, bool autosuspend);
 void snd_usb_endpoint_release(struct snd_usb_endpoint *ep);
 void snd_usb_endpoint_free_all(struct snd_usb_audio *chip);
+void snd_usb_endpoint_get_bandwidth(struct snd_usb_endpoint *ep,
+				    unsigned int *reserved, unsigned int *used);
+void snd_usb_endpoint_get_snapshot(struct snd_usb_endpoint *ep,
+				   struct snd_usb_ep_snapshot *snap);
 
 int snd_usb_endpoint_implicit_feedback_sink(struct snd_usb_endpoint *ep);
 int snd_usb_endpoint_next_packet_size(struct snd_usb_endpoint *ep,
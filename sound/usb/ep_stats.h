@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * Record layout of the binary proc "ep_stats" file of USB audio cards.
+ *
+ * The file holds one record per possible endpoint address (see
+ * ep_table_index()), each sizeof(struct snd_usb_ep_snapshot) bytes; unused
+ * slots read as zero.  The layout is ABI and free of implicit padding.
+ * Records are published at each URB completion under
+ * snd_usb_endpoint.snap_seq.
+ */
+#ifndef __USBAUDIO_EP_STATS_H
+#define __USBAUDIO_EP_STATS_H
+
+#include <linux/types.h>
+
+struct snd_usb_ep_snapshot {
+	__u32 size;		/* sizeof(struct snd_usb_ep_snapshot), 0 = unused */
+	__u32 ep_num;		/* endpoint address */
+	__u32 running;		/* EP_STATE_RUNNING */
+	__u32 freqm;		/* momentary rate in Q16.16 */
+	__u64 urbs;		/* completed URBs */
+	__u64 bytes;		/* transferred bytes */
+	__u32 xruns;		/* xruns reported by the endpoint */
+	__u32 submitted;	/* URBs in flight */
+	__u32 queue_depth;	/* implicit fb next_packet FIFO depth */
+	__u32 inflight_bytes;	/* playback bytes queued to the device */
+	__u64 timestamp_ns;	/* time of the snapshot (CLOCK_MONOTONIC) */
+};
+
+#endif /* __USBAUDIO_EP_STATS_H */
@@ -537,11 +537,10 @@ static int parse_audio_format_rates_v2v3(struct snd_usb_audio *chip,
 	}
 
 	/* get the number of sample rates first by only fetching 2 bytes */
-	ret = snd_usb_ctl_msg(dev, usb_rcvctrlpipe(dev, 0), UAC2_CS_RANGE,
-			      USB_TYPE_CLASS | USB_RECIP_INTERFACE | USB_DIR_IN,
-			      UAC2_CS_CONTROL_SAM_FREQ << 8,
-			      snd_usb_ctrl_intf(chip) | (clock << 8),
-			      tmp, sizeof(tmp));
+	ret = snd_usb_ctl_msg_cached(chip, UAC2_CS_RANGE,
+				     UAC2_CS_CONTROL_SAM_FREQ << 8,
+				     snd_usb_ctrl_intf(chip) | (clock << 8),
+				     tmp, sizeof(tmp));
 
 	if (ret < 0) {
 		/* line6 helix devices don't support UAC2_CS_CONTROL_SAM_FREQ call */
@@ -572,11 +571,10 @@ static int parse_audio_format_rates_v2v3(struct snd_usb_audio *chip,
 	}
 
 	/* now get the full information */
-	ret = snd_usb_ctl_msg(dev, usb_rcvctrlpipe(dev, 0), UAC2_CS_RANGE,
-			      USB_TYPE_CLASS | USB_RECIP_INTERFACE | USB_DIR_IN,
-			      UAC2_CS_CONTROL_SAM_FREQ << 8,
-			      snd_usb_ctrl_intf(chip) | (clock << 8),
-			      data, data_size);
+	ret = snd_usb_ctl_msg_cached(chip, UAC2_CS_RANGE,
+				     UAC2_CS_CONTROL_SAM_FREQ << 8,
+				     snd_usb_ctrl_intf(chip) | (clock << 8),
+				     data, data_size);
 
 	if (ret < 0) {
 		dev_err(&dev->dev,
@@ -3,7 +3,12 @@
  */
 
 #include <linux/init.h>
+#include <linux/jiffies.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/overflow.h>
 #include <linux/slab.h>
+#include <linux/string.h>
 #include <linux/usb.h>
 
 #include "usbaudio.h"
@@ -103,6 +108,237 @@ int snd_usb_ctl_msg(struct usb_device *dev, unsigned int pipe, __u8 request,
 	return err;
 }
 
+/*
+ * Cache of the static class-specific requests issued at probe time
+ * (UAC1 GET_MIN/MAX/RES, UAC2/3 RANGE).
+ *
+ * The entries of a disconnected device are stashed for
+ * snd_usb_reprobe_cache_secs, so that a reconnect of the same device
+ * (same USB ID, bcdDevice, serial number or port if the device has no
+ * serial, and the same raw configuration descriptors) skips these queries.
+ */
+struct snd_usb_ctl_cache_entry {
+	struct list_head list;
+	__u8 request;
+	__u16 value;
+	__u16 index;
+	__u16 size;
+	unsigned char data[];
+};
+
+struct snd_usb_ctl_cache_dev {
+	struct list_head list;
+	u32 usb_id;
+	u16 bcd_device;
+	int busnum;
+	char devpath[16];
+	char *serial;
+	void *config;		/* raw descriptors of the active config */
+	unsigned int config_len;
+	unsigned long expires;
+	struct list_head entries;
+};
+
+#define CTL_CACHE_MAX_DEVS	8
+
+static LIST_HEAD(ctl_cache_devs);
+static DEFINE_MUTEX(ctl_cache_mutex);
+static unsigned int ctl_cache_num_devs;
+
+/* issue a class-specific IN request to the interface, or take the cached reply */
+int snd_usb_ctl_msg_cached(struct snd_usb_audio *chip, __u8 request,
+			   __u16 value, __u16 index, void *data, __u16 size)
+{
+	struct usb_device *dev = chip->dev;
+	struct snd_usb_ctl_cache_entry *e;
+	unsigned long flags;
+	int err;
+
+	spin_lock_irqsave(&chip->ctl_cache_lock, flags);
+	list_for_each_entry(e, &chip->ctl_cache, list) {
+		if (e->request == request && e->value == value &&
+		    e->index == index && e->size == size) {
+			memcpy(data, e->data, size);
+			spin_unlock_irqrestore(&chip->ctl_cache_lock, flags);
+			return size;
+		}
+	}
+	spin_unlock_irqrestore(&chip->ctl_cache_lock, flags);
+
+	err = snd_usb_ctl_msg(dev, usb_rcvctrlpipe(dev, 0), request,
+			      USB_RECIP_INTERFACE | USB_TYPE_CLASS | USB_DIR_IN,
+			      value, index, data, size);
+	if (err != size)
+		return err;
+
+	e = kmalloc(struct_size(e, data, size), GFP_KERNEL);
+	if (!e)
+		return err;
+	e->request = request;
+	e->value = value;
+	e->index = index;
+	e->size = size;
+	memcpy(e->data, data, size);
+	spin_lock_irqsave(&chip->ctl_cache_lock, flags);
+	list_add(&e->list, &chip->ctl_cache);
+	spin_unlock_irqrestore(&chip->ctl_cache_lock, flags);
+	return err;
+}
+
+static void ctl_cache_free_entries(struct list_head *entries)
+{
+	struct snd_usb_ctl_cache_entry *e, *n;
+
+	list_for_each_entry_safe(e, n, entries, list)
+		kfree(e);
+	INIT_LIST_HEAD(entries);
+}
+
+static void ctl_cache_free_dev(struct snd_usb_ctl_cache_dev *cd)
+{
+	list_del(&cd->list);
+	ctl_cache_num_devs--;
+	ctl_cache_free_entries(&cd->entries);
+	kfree(cd->serial);
+	kfree(cd->config);
+	kfree(cd);
+}
+
+/* drop the expired devices; call with ctl_cache_mutex held */
+static void ctl_cache_expire(void)
+{
+	struct snd_usb_ctl_cache_dev *cd, *n;
+
+	list_for_each_entry_safe(cd, n, &ctl_cache_devs, list)
+		if (time_after(jiffies, cd->expires))
+			ctl_cache_free_dev(cd);
+}
+
+/*
+ * Raw descriptors of the active configuration; devices that switch modes
+ * re-enumerate with the same IDs but different descriptors.
+ */
+static const void *ctl_cache_config(struct usb_device *dev,
+				    unsigned int *len)
+{
+	struct usb_host_config *cfg = dev->actconfig;
+
+	if (!cfg || !dev->rawdescriptors)
+		return NULL;
+	*len = le16_to_cpu(cfg->desc.wTotalLength);
+	return dev->rawdescriptors[cfg - dev->config];
+}
+
+static bool ctl_cache_match(struct snd_usb_ctl_cache_dev *cd,
+			    struct snd_usb_audio *chip)
+{
+	struct usb_device *dev = chip->dev;
+	const void *config;
+	unsigned int len;
+
+	if (cd->usb_id != chip->usb_id ||
+	    cd->bcd_device != le16_to_cpu(dev->descriptor.bcdDevice))
+		return false;
+	config = ctl_cache_config(dev, &len);
+	if (!config || len != cd->config_len ||
+	    memcmp(config, cd->config, len))
+		return false;
+	if (cd->serial || dev->serial)
+		return cd->serial && dev->serial &&
+			!strcmp(cd->serial, dev->serial);
+	return cd->busnum == dev->bus->busnum &&
+		!strcmp(cd->devpath, dev->devpath);
+}
+
+/* keep the cached replies of a disconnected device for a while */
+void snd_usb_ctl_cache_stash(struct snd_usb_audio *chip)
+{
+	struct usb_device *dev = chip->dev;
+	struct snd_usb_ctl_cache_dev *cd;
+	const void *config;
+	unsigned int len;
+	unsigned long flags;
+
+	if (!snd_usb_reprobe_cache_secs || list_empty(&chip->ctl_cache))
+		goto out;
+	config = ctl_cache_config(dev, &len);
+	if (!config)
+		goto out;
+
+	cd = kzalloc(sizeof(*cd), GFP_KERNEL);
+	if (!cd)
+		goto out;
+	cd->config = kmemdup(config, len, GFP_KERNEL);
+	if (!cd->config) {
+		kfree(cd);
+		goto out;
+	}
+	cd->config_len = len;
+	cd->usb_id = chip->usb_id;
+	cd->bcd_device = le16_to_cpu(dev->descriptor.bcdDevice);
+	cd->busnum = dev->bus->busnum;
+	strscpy(cd->devpath, dev->devpath, sizeof(cd->devpath));
+	if (dev->serial)
+		cd->serial = kstrdup(dev->serial, GFP_KERNEL);
+	cd->expires = jiffies + snd_usb_reprobe_cache_secs * HZ;
+	INIT_LIST_HEAD(&cd->entries);
+	spin_lock_irqsave(&chip->ctl_cache_lock, flags);
+	list_splice_init(&chip->ctl_cache, &cd->entries);
+	spin_unlock_irqrestore(&chip->ctl_cache_lock, flags);
+
+	mutex_lock(&ctl_cache_mutex);
+	ctl_cache_expire();
+	if (ctl_cache_num_devs >= CTL_CACHE_MAX_DEVS)
+		ctl_cache_free_dev(list_first_entry(&ctl_cache_devs,
+					struct snd_usb_ctl_cache_dev, list));
+	list_add_tail(&cd->list, &ctl_cache_devs);
+	ctl_cache_num_devs++;
+	mutex_unlock(&ctl_cache_mutex);
+
+ out:
+	snd_usb_ctl_cache_free(chip);
+}
+
+/* take over the stashed replies of the same device at probe */
+void snd_usb_ctl_cache_restore(struct snd_usb_audio *chip)
+{
+	struct snd_usb_ctl_cache_dev *cd;
+
+	mutex_lock(&ctl_cache_mutex);
+	ctl_cache_expire();
+	list_for_each_entry(cd, &ctl_cache_devs, list) {
+		if (ctl_cache_match(cd, chip)) {
+			list_splice_init(&cd->entries, &chip->ctl_cache);
+			ctl_cache_free_dev(cd);
+			usb_audio_dbg(chip, "reusing cached probe data\n");
+			break;
+		}
+	}
+	mutex_unlock(&ctl_cache_mutex);
+}
+
+void snd_usb_ctl_cache_free(struct snd_usb_audio *chip)
+{
+	unsigned long flags;
+	LIST_HEAD(entries);
+
+	spin_lock_irqsave(&chip->ctl_cache_lock, flags);
+	list_splice_init(&chip->ctl_cache, &entries);
+	spin_unlock_irqrestore(&chip->ctl_cache_lock, flags);
+	ctl_cache_free_entries(&entries);
+}
+
+/* called at module exit */
+void snd_usb_ctl_cache_cleanup(void)
+{
+	struct snd_usb_ctl_cache_dev *cd, *n;
+
+	mutex_lock(&ctl_cache_mutex);
+	list_for_each_entry_safe(cd, n, &ctl_cache_devs, list)
+		ctl_cache_free_dev(cd);
+	mutex_unlock(&ctl_cache_mutex);
+}
+
 unsigned char snd_usb_parse_datainterval(struct snd_usb_audio *chip,
 					 struct usb_host_interface *alts)
 {
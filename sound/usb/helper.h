@@ -11,6 +11,13 @@ int snd_usb_ctl_msg(struct usb_device *dev, unsigned int pipe,
 		    __u8 request, __u8 requesttype, __u16 value, __u16 index,
 		    void *data, __u16 size);
 
+int snd_usb_ctl_msg_cached(struct snd_usb_audio *chip, __u8 request,
+			   __u16 value, __u16 index, void *data, __u16 size);
+void snd_usb_ctl_cache_stash(struct snd_usb_audio *chip);
+void snd_usb_ctl_cache_restore(struct snd_usb_audio *chip);
+void snd_usb_ctl_cache_free(struct snd_usb_audio *chip);
+void snd_usb_ctl_cache_cleanup(void);
+
 unsigned char snd_usb_parse_datainterval(struct snd_usb_audio *chip,
 					 struct usb_host_interface *alts);
 
@@ -15,6 +15,7 @@
 #include "usbaudio.h"
 #include "card.h"
 #include "helper.h"
+#include "endpoint.h"
 #include "pcm.h"
 #include "implicit.h"
 
@@ -468,8 +469,7 @@ snd_usb_find_implicit_fb_sync_format(struct snd_usb_audio *chip,
 	    target->altsetting == target->sync_altsetting)
 		sync_fmt = target;
 
-	subs = find_matching_substream(chip, stream, target->sync_ep,
-				       target->fmt_type);
+	subs = target->sync_subs;
 	if (!subs)
 		goto end;
 
@@ -491,3 +491,32 @@ snd_usb_find_implicit_fb_sync_format(struct snd_usb_audio *chip,
 	return sync_fmt;
 }
 
+/*
+ * Resolve the sync EP object and the implicit fb partner substream of all
+ * parsed audioformats, so that hw_params and the hw constraint rules can
+ * use them directly.  Called after each interface probe; the partner stream
+ * may show up only with a later interface.
+ */
+void snd_usb_setup_implicit_fb_links(struct snd_usb_audio *chip)
+{
+	struct snd_usb_stream *as;
+	struct audioformat *fp;
+	int stream;
+
+	list_for_each_entry(as, &chip->pcm_list, list) {
+		for (stream = 0; stream < 2; stream++) {
+			list_for_each_entry(fp, &as->substream[stream].fmt_list,
+					    list) {
+				if (!fp->sync_ep)
+					continue;
+				fp->sync_endpoint =
+					snd_usb_get_endpoint(chip, fp->sync_ep);
+				if (fp->implicit_fb)
+					fp->sync_subs =
+						find_matching_substream(chip, !stream,
+									fp->sync_ep,
+									fp->fmt_type);
+			}
+		}
+	}
+}
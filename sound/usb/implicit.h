@@ -10,5 +10,6 @@ snd_usb_find_implicit_fb_sync_format(struct snd_usb_audio *chip,
 				     const struct audioformat *target,
 				     const struct snd_pcm_hw_params *params,
 				     int stream, bool *fixed_rate);
+void snd_usb_setup_implicit_fb_links(struct snd_usb_audio *chip);
 
 #endif /* __USBAUDIO_IMPLICIT_H */
@@ -17,8 +17,7 @@
 #define line6_rawmidi_substream_midi(substream) \
 	((struct snd_line6_midi *)((substream)->rmidi->private_data))
 
-static int send_midi_async(struct usb_line6 *line6, unsigned char *data,
-			   int length);
+static int send_midi_async(struct usb_line6 *line6, int index, int length);
 
 /*
 	Pass data received via USB to MIDI.
@@ -41,7 +40,7 @@ static void line6_midi_transmit(struct snd_rawmidi_substream *substream)
 	struct snd_line6_midi *line6midi = line6->line6midi;
 	struct midi_buffer *mb = &line6midi->midibuf_out;
 	unsigned char chunk[LINE6_FALLBACK_MAXPACKETSIZE];
-	int req, done;
+	int req, done, i;
 
 	for (;;) {
 		req = min3(line6_midibuf_bytes_free(mb), line6->max_packet_size,
@@ -55,15 +54,23 @@ static void line6_midi_transmit(struct snd_rawmidi_substream *substream)
 		snd_rawmidi_transmit_ack(substream, done);
 	}
 
+	/* read the packets directly into the free URBs of the pool */
 	for (;;) {
-		done = line6_midibuf_read(mb, chunk,
+		i = find_first_zero_bit(&line6midi->send_urbs_busy,
+					LINE6_MIDI_SEND_URBS);
+		if (i >= LINE6_MIDI_SEND_URBS)
+			break;
+
+		done = line6_midibuf_read(mb,
+					  line6midi->send_urbs[i]->transfer_buffer,
 					  LINE6_FALLBACK_MAXPACKETSIZE,
 					  LINE6_MIDIBUF_READ_TX);
 
 		if (done == 0)
 			break;
 
-		send_midi_async(line6, chunk, done);
+		if (send_midi_async(line6, i, done) < 0)
+			break;
 	}
 }
 
@@ -75,58 +82,51 @@ static void midi_sent(struct urb *urb)
 	unsigned long flags;
 	int status;
 	int num;
+	int i;
 	struct usb_line6 *line6 = (struct usb_line6 *)urb->context;
+	struct snd_line6_midi *line6midi = line6->line6midi;
 
 	status = urb->status;
-	kfree(urb->transfer_buffer);
-	usb_free_urb(urb);
 
-	if (status == -ESHUTDOWN)
-		return;
+	spin_lock_irqsave(&line6midi->lock, flags);
+	for (i = 0; i < LINE6_MIDI_SEND_URBS; i++) {
+		if (line6midi->send_urbs[i] == urb) {
+			clear_bit(i, &line6midi->send_urbs_busy);
+			break;
+		}
+	}
+	num = --line6midi->num_active_send_urbs;
 
-	spin_lock_irqsave(&line6->line6midi->lock, flags);
-	num = --line6->line6midi->num_active_send_urbs;
+	if (status == -ESHUTDOWN) {
+		spin_unlock_irqrestore(&line6midi->lock, flags);
+		return;
+	}
 
-	if (num == 0) {
-		line6_midi_transmit(line6->line6midi->substream_transmit);
-		num = line6->line6midi->num_active_send_urbs;
+	/* refill the freed URB right away to keep SysEx streams flowing */
+	if (line6midi->substream_transmit) {
+		line6_midi_transmit(line6midi->substream_transmit);
+		num = line6midi->num_active_send_urbs;
 	}
 
 	if (num == 0)
-		wake_up(&line6->line6midi->send_wait);
+		wake_up(&line6midi->send_wait);
 
-	spin_unlock_irqrestore(&line6->line6midi->lock, flags);
+	spin_unlock_irqrestore(&line6midi->lock, flags);
 }
 
 /*
-	Send an asynchronous MIDI message.
+	Send an asynchronous MIDI message from the pool URB at @index, whose
+	transfer buffer already holds @length bytes.
 	Assumes that line6->line6midi->lock is held
 	(i.e., this function is serialized).
 */
-static int send_midi_async(struct usb_line6 *line6, unsigned char *data,
-			   int length)
+static int send_midi_async(struct usb_line6 *line6, int index, int length)
 {
-	struct urb *urb;
+	struct snd_line6_midi *line6midi = line6->line6midi;
+	struct urb *urb = line6midi->send_urbs[index];
 	int retval;
-	unsigned char *transfer_buffer;
-
-	urb = usb_alloc_urb(0, GFP_ATOMIC);
-
-	if (urb == NULL)
-		return -ENOMEM;
-
-	transfer_buffer = kmemdup(data, length, GFP_ATOMIC);
-
-	if (transfer_buffer == NULL) {
-		usb_free_urb(urb);
-		return -ENOMEM;
-	}
 
-	usb_fill_int_urb(urb, line6->usbdev,
-			 usb_sndintpipe(line6->usbdev,
-					 line6->properties->ep_ctrl_w),
-			 transfer_buffer, length, midi_sent, line6,
-			 line6->interval);
+	urb->transfer_buffer_length = length;
 	urb->actual_length = 0;
 	retval = usb_urb_ep_type_check(urb);
 	if (retval < 0)
@@ -136,12 +136,12 @@ static int send_midi_async(struct usb_line6 *line6, unsigned char *data,
 	if (retval < 0)
 		goto error;
 
-	++line6->line6midi->num_active_send_urbs;
+	set_bit(index, &line6midi->send_urbs_busy);
+	++line6midi->num_active_send_urbs;
 	return 0;
 
  error:
 	dev_err(line6->ifcdev, "usb_submit_urb failed\n");
-	usb_free_urb(urb);
 	return retval;
 }
 
@@ -165,7 +165,7 @@ static void line6_midi_output_trigger(struct snd_rawmidi_substream *substream,
 	line6->line6midi->substream_transmit = substream;
 	spin_lock_irqsave(&line6->line6midi->lock, flags);
 
-	if (line6->line6midi->num_active_send_urbs == 0)
+	if (line6->line6midi->num_active_send_urbs < LINE6_MIDI_SEND_URBS)
 		line6_midi_transmit(substream);
 
 	spin_unlock_irqrestore(&line6->line6midi->lock, flags);
@@ -242,11 +242,56 @@ static int snd_line6_new_midi(struct usb_line6 *line6,
 	return 0;
 }
 
+/* Release the pool of MIDI send URBs */
+static void line6_midi_free_send_urbs(struct snd_line6_midi *line6midi)
+{
+	struct urb *urb;
+	int i;
+
+	for (i = 0; i < LINE6_MIDI_SEND_URBS; i++) {
+		urb = line6midi->send_urbs[i];
+		if (!urb)
+			continue;
+		usb_kill_urb(urb);
+		kfree(urb->transfer_buffer);
+		usb_free_urb(urb);
+		line6midi->send_urbs[i] = NULL;
+	}
+}
+
+/* Allocate the pool of MIDI send URBs */
+static int line6_midi_alloc_send_urbs(struct snd_line6_midi *line6midi)
+{
+	struct usb_line6 *line6 = line6midi->line6;
+	unsigned char *buffer;
+	struct urb *urb;
+	int i;
+
+	for (i = 0; i < LINE6_MIDI_SEND_URBS; i++) {
+		urb = usb_alloc_urb(0, GFP_KERNEL);
+		if (!urb)
+			return -ENOMEM;
+		buffer = kmalloc(LINE6_FALLBACK_MAXPACKETSIZE, GFP_KERNEL);
+		if (!buffer) {
+			usb_free_urb(urb);
+			return -ENOMEM;
+		}
+		usb_fill_int_urb(urb, line6->usbdev,
+				 usb_sndintpipe(line6->usbdev,
+						line6->properties->ep_ctrl_w),
+				 buffer, LINE6_FALLBACK_MAXPACKETSIZE,
+				 midi_sent, line6, line6->interval);
+		line6midi->send_urbs[i] = urb;
+	}
+	return 0;
+}
+
 /* MIDI device destructor */
 static void snd_line6_midi_free(struct snd_rawmidi *rmidi)
 {
 	struct snd_line6_midi *line6midi = rmidi->private_data;
 
+	line6_midi_free_send_urbs(line6midi);
 	line6_midibuf_destroy(&line6midi->midibuf_in);
 	line6_midibuf_destroy(&line6midi->midibuf_out);
 	kfree(line6midi);
@@ -289,6 +334,10 @@ int line6_init_midi(struct usb_line6 *line6)
 	if (err < 0)
 		return err;
 
+	err = line6_midi_alloc_send_urbs(line6midi);
+	if (err < 0)
+		return err;
+
 	line6->line6midi = line6midi;
 	return 0;
 }
@@ -14,6 +14,9 @@
 
 #define MIDI_BUFFER_SIZE 1024
 
+/* number of preallocated URBs for MIDI transmission */
+#define LINE6_MIDI_SEND_URBS 8
+
 struct snd_line6_midi {
 	/* Pointer back to the Line 6 driver data structure */
 	struct usb_line6 *line6;
@@ -27,6 +30,12 @@ struct snd_line6_midi {
 	/* Number of currently active MIDI send URBs */
 	int num_active_send_urbs;
 
+	/* Pool of send URBs with their transfer buffers, reused for every
+	 * packet so that long SysEx streams don't allocate per packet
+	 */
+	struct urb *send_urbs[LINE6_MIDI_SEND_URBS];
+	unsigned long send_urbs_busy;
+
 	/* Spin lock to protect MIDI buffer handling */
 	spinlock_t lock;
 
@@ -319,9 +319,13 @@ static int get_ctl_value_v1(struct usb_mixer_elem_info *cval, int request,
 
 	while (timeout-- > 0) {
 		idx = mixer_ctrl_intf(cval->head.mixer) | (cval->head.id << 8);
-		err = snd_usb_ctl_msg(chip->dev, usb_rcvctrlpipe(chip->dev, 0), request,
-				      USB_RECIP_INTERFACE | USB_TYPE_CLASS | USB_DIR_IN,
-				      validx, idx, buf, val_len);
+		if (request != UAC_GET_CUR)
+			err = snd_usb_ctl_msg_cached(chip, request, validx, idx,
+						     buf, val_len);
+		else
+			err = snd_usb_ctl_msg(chip->dev, usb_rcvctrlpipe(chip->dev, 0), request,
+					      USB_RECIP_INTERFACE | USB_TYPE_CLASS | USB_DIR_IN,
+					      validx, idx, buf, val_len);
 		if (err >= val_len) {
 			*value_ret = convert_signed_value(cval, snd_usb_combine_bytes(buf, val_len));
 			err = 0;
@@ -366,9 +370,13 @@ static int get_ctl_value_v2(struct usb_mixer_elem_info *cval, int request,
 		return -EIO;
 
 	idx = mixer_ctrl_intf(cval->head.mixer) | (cval->head.id << 8);
-	ret = snd_usb_ctl_msg(chip->dev, usb_rcvctrlpipe(chip->dev, 0), bRequest,
-			      USB_RECIP_INTERFACE | USB_TYPE_CLASS | USB_DIR_IN,
-			      validx, idx, buf, size);
+	if (bRequest == UAC2_CS_RANGE)
+		ret = snd_usb_ctl_msg_cached(chip, bRequest, validx, idx,
+					     buf, size);
+	else
+		ret = snd_usb_ctl_msg(chip->dev, usb_rcvctrlpipe(chip->dev, 0), bRequest,
+				      USB_RECIP_INTERFACE | USB_TYPE_CLASS | USB_DIR_IN,
+				      validx, idx, buf, size);
 	snd_usb_unlock_shutdown(chip);
 
 	if (ret < 0) {
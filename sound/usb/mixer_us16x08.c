@@ -484,58 +484,111 @@ static int snd_us16x08_comp_put(struct snd_kcontrol *kcontrol,
 static int snd_us16x08_eqswitch_get(struct snd_kcontrol *kcontrol,
 	struct snd_ctl_elem_value *ucontrol)
 {
-	int val;
 	struct usb_mixer_elem_info *elem = kcontrol->private_data;
 	struct snd_us16x08_eq_store *store = elem->private_data;
 	int index = ucontrol->id.index;
 
-	/* get low switch from cache is enough, cause all bands are together */
-	val = store->val[EQ_STORE_BAND_IDX(elem->head.id)]
-		[EQ_STORE_PARAM_IDX(elem->head.id)][index];
-	ucontrol->value.integer.value[0] = val;
+	/* report the requested value even if it's still being sent */
+	ucontrol->value.integer.value[0] = store->eqsw_req[index];
 
 	return 0;
 }
 
+/*
+ * Send the EQ switch updates queued by snd_us16x08_eqswitch_put().  All four
+ * EQ bands of a channel have to be switched, one message per band, and the
+ * device needs some time between them; so each run sends a single message
+ * and re-arms itself SND_US16X08_EQ_SWITCH_DELAY ms later.  Once all bands
+ * of a channel are written, the control change is notified.
+ */
+static void snd_us16x08_eqsw_work(struct work_struct *work)
+{
+	struct snd_us16x08_eq_store *store =
+		container_of(to_delayed_work(work), struct snd_us16x08_eq_store,
+			     eqsw_work);
+	struct usb_mixer_elem_info *elem = store->eqsw_elem;
+	struct snd_usb_audio *chip = elem->head.mixer->chip;
+	struct snd_ctl_elem_id id;
+	char buf[sizeof(eqs_msq)];
+	int ch, b_idx, val, err;
+	bool done;
+
+	spin_lock_irq(&store->eqsw_lock);
+	if (store->eqsw_chan < 0) {
+		if (!store->eqsw_pending) {
+			store->eqsw_busy = false;
+			spin_unlock_irq(&store->eqsw_lock);
+			return;
+		}
+		/* toggles queued meanwhile were merged into eqsw_req */
+		ch = __ffs(store->eqsw_pending);
+		store->eqsw_pending &= ~(1 << ch);
+		store->eqsw_chan = ch;
+		store->eqsw_band = 0;
+		store->eqsw_val = store->eqsw_req[ch];
+	}
+	ch = store->eqsw_chan;
+	val = store->eqsw_val;
+	b_idx = store->eqsw_band++;
+	done = store->eqsw_band == SND_US16X08_ID_EQ_BAND_COUNT;
+	if (done)
+		store->eqsw_chan = -1;
+	spin_unlock_irq(&store->eqsw_lock);
+
+	/* prepare URB message from EQ template */
+	memcpy(buf, eqs_msq, sizeof(eqs_msq));
+	buf[5] = ch + 1;
+	buf[20] = val;
+	buf[17] = store->val[b_idx][2][ch];
+	buf[14] = store->val[b_idx][1][ch];
+	buf[11] = store->val[b_idx][0][ch];
+	buf[8] = b_idx + 1;
+	err = snd_us16x08_send_urb(chip, buf, sizeof(eqs_msq));
+	if (err < 0) {
+		usb_audio_dbg(chip, "Failed to set eq switch, err:%d\n", err);
+		/* give up on this channel and report the current state */
+		spin_lock_irq(&store->eqsw_lock);
+		store->eqsw_chan = -1;
+		if (!(store->eqsw_pending & (1 << ch)))
+			store->eqsw_req[ch] = store->val[0][3][ch];
+		spin_unlock_irq(&store->eqsw_lock);
+		done = true;
+	} else {
+		store->val[b_idx][3][ch] = val;
+		if (done) {
+			elem->cached |= 1 << ch;
+			elem->cache_val[ch] = val;
+		}
+	}
+
+	if (done)
+		snd_ctl_notify(chip->card, SNDRV_CTL_EVENT_MASK_VALUE,
+			       snd_ctl_build_ioff(&id, elem->head.kctl, ch));
+
+	schedule_delayed_work(&store->eqsw_work,
+			      msecs_to_jiffies(SND_US16X08_EQ_SWITCH_DELAY));
+}
+
 static int snd_us16x08_eqswitch_put(struct snd_kcontrol *kcontrol,
 	struct snd_ctl_elem_value *ucontrol)
 {
 	struct usb_mixer_elem_info *elem = kcontrol->private_data;
-	struct snd_usb_audio *chip = elem->head.mixer->chip;
 	struct snd_us16x08_eq_store *store = elem->private_data;
 	int index = ucontrol->id.index;
-	char buf[sizeof(eqs_msq)];
-	int val, err = 0;
-	int b_idx;
+	int val;
 
 	/* new control value incl. bias*/
 	val = ucontrol->value.integer.value[0] + SND_US16X08_KCBIAS(kcontrol);
 
-	/* prepare URB message from EQ template */
-	memcpy(buf, eqs_msq, sizeof(eqs_msq));
-
-	/* place channel index in URB message */
-	buf[5] = index + 1;
-	for (b_idx = 0; b_idx < SND_US16X08_ID_EQ_BAND_COUNT; b_idx++) {
-		/* all four EQ bands have to be enabled/disabled in once */
-		buf[20] = val;
-		buf[17] = store->val[b_idx][2][index];
-		buf[14] = store->val[b_idx][1][index];
-		buf[11] = store->val[b_idx][0][index];
-		buf[8] = b_idx + 1;
-		err = snd_us16x08_send_urb(chip, buf, sizeof(eqs_msq));
-		if (err < 0)
-			break;
-		store->val[b_idx][3][index] = val;
-		msleep(15);
-	}
-
-	if (err > 0) {
-		elem->cached |= 1 << index;
-		elem->cache_val[index] = val;
-	} else {
-		usb_audio_dbg(chip, "Failed to set eq switch, err:%d\n", err);
+	/* queue the update; the messages are sent from snd_us16x08_eqsw_work */
+	spin_lock_irq(&store->eqsw_lock);
+	store->eqsw_req[index] = val;
+	store->eqsw_pending |= 1 << index;
+	if (!store->eqsw_busy) {
+		store->eqsw_busy = true;
+		schedule_delayed_work(&store->eqsw_work, 0);
 	}
+	spin_unlock_irq(&store->eqsw_lock);
 
 	return 1;
 }
@@ -988,7 +1041,15 @@ static struct snd_us16x08_eq_store *snd_us16x08_create_eq_store(void)
 	if (!tmp)
 		return NULL;
 
+	spin_lock_init(&tmp->eqsw_lock);
+	INIT_DELAYED_WORK(&tmp->eqsw_work, snd_us16x08_eqsw_work);
+	tmp->eqsw_elem = NULL;
+	tmp->eqsw_busy = false;
+	tmp->eqsw_pending = 0;
+	tmp->eqsw_chan = -1;
+
 	for (i = 0; i < SND_US16X08_MAX_CHANNELS; i++) {
+		tmp->eqsw_req[i] = 0x00;
 		for (b_idx = 0; b_idx < SND_US16X08_ID_EQ_BAND_COUNT; b_idx++) {
 			tmp->val[b_idx][0][i] = 0x0c;
 			tmp->val[b_idx][3][i] = 0x00;
@@ -1039,6 +1100,19 @@ static void elem_private_free(struct snd_kcontrol *kctl)
 	kctl->private_data = NULL;
 }
 
+/* the EQ switch owns the EQ store; stop its queued updates first */
+static void snd_us16x08_eq_private_free(struct snd_kcontrol *kctl)
+{
+	struct usb_mixer_elem_info *elem = kctl->private_data;
+
+	if (elem) {
+		struct snd_us16x08_eq_store *store = elem->private_data;
+
+		cancel_delayed_work_sync(&store->eqsw_work);
+	}
+	elem_private_free(kctl);
+}
+
 static int add_new_ctl(struct usb_mixer_interface *mixer,
 	const struct snd_kcontrol_new *ncontrol,
 	int index, int val_type, int channels,
@@ -1373,9 +1447,15 @@ int snd_us16x08_controls_create(struct usb_mixer_interface *mixer)
 				eq_controls[i].name,
 				eq_store,
 				i == 0, /* release eq_store only once */
-				NULL);
+				&elem);
 			if (err < 0)
 				return err;
+			if (i == 0) {
+				/* EQ switch, sends the queued EQ updates */
+				eq_store->eqsw_elem = elem;
+				elem->head.kctl->private_free =
+					snd_us16x08_eq_private_free;
+			}
 		}
 
 		/* add compressor controls */
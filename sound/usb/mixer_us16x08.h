@@ -89,9 +89,23 @@
 
 #define COMP_STORE_IDX(x) ((x) - SND_US16X08_ID_COMP_BASE)
 
+/* delay between two EQ band messages of an EQ switch update */
+#define SND_US16X08_EQ_SWITCH_DELAY 15
+
 struct snd_us16x08_eq_store {
 	u8 val[SND_US16X08_ID_EQ_BAND_COUNT][SND_US16X08_ID_EQ_PARAM_COUNT]
 		[SND_US16X08_MAX_CHANNELS];
+
+	/* queued EQ switch updates, sent one band at a time by eqsw_work */
+	spinlock_t eqsw_lock;
+	struct delayed_work eqsw_work;
+	struct usb_mixer_elem_info *eqsw_elem;	/* the EQ switch control */
+	bool eqsw_busy;				/* eqsw_work is scheduled */
+	u16 eqsw_pending;			/* channels to be updated */
+	u8 eqsw_req[SND_US16X08_MAX_CHANNELS];	/* last requested values */
+	int eqsw_chan;				/* channel in progress or -1 */
+	int eqsw_band;				/* next band to send */
+	u8 eqsw_val;				/* value being sent */
 };
 
 struct snd_us16x08_comp_store {
@@ -84,6 +84,69 @@ static snd_pcm_uframes_t snd_usb_pcm_pointer(struct snd_pcm_substream *substream
 	return bytes_to_frames(runtime, hwptr_done);
 }
 
+/*
+ * Largest packet in bytes that @fp must carry for the given stream, with
+ * 1/8 headroom (at least one frame) for feedback or adaptive rate drift.
+ * Returns 0 when bandwidth-aware selection is disabled.
+ */
+static unsigned int format_packet_bytes(struct snd_usb_substream *subs,
+					const struct audioformat *fp,
+					snd_pcm_format_t format,
+					unsigned int rate,
+					unsigned int channels)
+{
+	struct snd_usb_audio *chip;
+	unsigned int pps, frames, frame_bytes, attr;
+
+	if (!subs)
+		return 0;
+	chip = subs->stream->chip;
+	if (!chip->tune.altset_bw)
+		return 0;
+
+	if (snd_usb_get_speed(chip->dev) == USB_SPEED_FULL)
+		pps = 1000 >> fp->datainterval;
+	else
+		pps = 8000 >> fp->datainterval;
+	frames = DIV_ROUND_UP(rate, pps);
+	attr = fp->ep_attr & USB_ENDPOINT_SYNCTYPE;
+	if (fp->implicit_fb || attr == USB_ENDPOINT_SYNC_ASYNC ||
+	    attr == USB_ENDPOINT_SYNC_ADAPTIVE)
+		frames += DIV_ROUND_UP(frames, 8);
+
+	frame_bytes = snd_pcm_format_physical_width(format) / 8 * channels;
+	if (fp->dsd_dop)
+		frame_bytes += channels;
+
+	return frames * frame_bytes +
+		((chip->quirk_flags & QUIRK_FLAG_TX_LENGTH) ? sizeof(__le32) : 0);
+}
+
+/*
+ * Whether @fp should replace @found: the smallest max. packet size that
+ * carries the stream wins, and if none does, the largest one.  Without
+ * a packet requirement (altset_bw off), simply the largest, as before.
+ */
+static bool format_packsize_better(const struct audioformat *fp,
+				   unsigned int fp_need,
+				   const struct audioformat *found,
+				   unsigned int found_need)
+{
+	bool fits, found_fits;
+
+	if (!fp_need && !found_need)
+		return fp->maxpacksize > found->maxpacksize;
+
+	/* an unknown requirement never counts as fitting */
+	fits = fp_need && fp->maxpacksize >= fp_need;
+	found_fits = found_need && found->maxpacksize >= found_need;
+	if (fits != found_fits)
+		return fits;
+	if (fits)
+		return fp->maxpacksize < found->maxpacksize;
+	return fp->maxpacksize > found->maxpacksize;
+}
+
 /*
  * find a matching audio format
  */
@@ -94,6 +157,7 @@ find_format(struct list_head *fmt_list_head, snd_pcm_format_t format,
 {
 	const struct audioformat *fp;
 	const struct audioformat *found = NULL;
+	unsigned int need, found_need = 0;
 	int cur_attr = 0, attr;
 
 	list_for_each_entry(fp, fmt_list_head, list) {
@@ -114,8 +178,11 @@ find_format(struct list_head *fmt_list_head, snd_pcm_format_t format,
 				continue;
 		}
 		attr = fp->ep_attr & USB_ENDPOINT_SYNCTYPE;
+		need = strict_match ?
+			format_packet_bytes(subs, fp, format, rate, channels) : 0;
 		if (!found) {
 			found = fp;
+			found_need = need;
 			cur_attr = attr;
 			continue;
 		}
@@ -135,13 +202,15 @@ find_format(struct list_head *fmt_list_head, snd_pcm_format_t format,
 			    (cur_attr == USB_ENDPOINT_SYNC_ADAPTIVE &&
 			     subs->direction == SNDRV_PCM_STREAM_CAPTURE)) {
 				found = fp;
+				found_need = need;
 				cur_attr = attr;
 				continue;
 			}
 		}
-		/* find the format with the largest max. packet size */
-		if (fp->maxpacksize > found->maxpacksize) {
+		/* pick the altsetting reserving the least bus bandwidth */
+		if (format_packsize_better(fp, need, found, found_need)) {
 			found = fp;
+			found_need = need;
 			cur_attr = attr;
 		}
 	}
@@ -416,6 +485,16 @@ static int snd_usb_pcm_change_state(struct snd_usb_substream *subs, int state)
 	return 0;
 }
 
+/* put an unused stream into the power state chosen by the idle policy */
+static int snd_usb_pcm_idle_state(struct snd_usb_substream *subs)
+{
+	if (!subs->str_pd)
+		return 0;
+	return snd_usb_pcm_change_state(subs,
+		snd_usb_power_domain_idle_state(subs->stream->chip,
+						subs->str_pd));
+}
+
 int snd_usb_pcm_suspend(struct snd_usb_stream *as)
 {
 	int ret;
@@ -435,11 +514,11 @@ int snd_usb_pcm_resume(struct snd_usb_stream *as)
 {
 	int ret;
 
-	ret = snd_usb_pcm_change_state(&as->substream[0], UAC3_PD_STATE_D1);
+	ret = snd_usb_pcm_idle_state(&as->substream[0]);
 	if (ret < 0)
 		return ret;
 
-	ret = snd_usb_pcm_change_state(&as->substream[1], UAC3_PD_STATE_D1);
+	ret = snd_usb_pcm_idle_state(&as->substream[1]);
 	if (ret < 0)
 		return ret;
 
@@ -520,9 +599,14 @@ static int snd_usb_hw_params(struct snd_pcm_substream *substream,
 	if (ret < 0)
 		goto stop_pipeline;
 
+	/* the D0 recovery runs in parallel with the endpoint setup below */
 	ret = snd_usb_pcm_change_state(subs, UAC3_PD_STATE_D0);
 	if (ret < 0)
 		goto unlock;
+	if (subs->str_pd)
+		subs->str_pd->period_us =
+			div_u64((u64)params_period_size(hw_params) * 1000000,
+				params_rate(hw_params));
 
 	if (subs->data_endpoint) {
 		if (snd_usb_endpoint_compatible(chip, subs->data_endpoint,
@@ -654,6 +738,10 @@ static int snd_usb_pcm_prepare(struct snd_pcm_substream *substream)
 	if (ret < 0)
 		goto unlock;
 
+	/* let the power domain finish D0 before any interface or rate setup */
+	if (subs->str_pd)
+		snd_usb_power_domain_wait(subs->str_pd);
+
  again:
 	if (subs->sync_endpoint) {
 		ret = snd_usb_endpoint_prepare(chip, subs->sync_endpoint);
@@ -811,6 +899,18 @@ get_endpoint_in_use(struct snd_usb_audio *chip, int endpoint,
 	return NULL;
 }
 
+/* same as above, but for the sync EP resolved at probe time */
+static const struct snd_usb_endpoint *
+sync_endpoint_in_use(const struct audioformat *fp,
+		     const struct snd_usb_endpoint *ref_ep)
+{
+	const struct snd_usb_endpoint *ep = fp->sync_endpoint;
+
+	if (ep && ep->cur_audiofmt && (ep != ref_ep || ep->opened > 1))
+		return ep;
+	return NULL;
+}
+
 static int hw_rule_rate(struct snd_pcm_hw_params *params,
 			struct snd_pcm_hw_rule *rule)
 {
@@ -840,8 +940,7 @@ static int hw_rule_rate(struct snd_pcm_hw_params *params,
 		}
 
 		if (fp->implicit_fb) {
-			ep = get_endpoint_in_use(chip, fp->sync_ep,
-						 subs->sync_endpoint);
+			ep = sync_endpoint_in_use(fp, subs->sync_endpoint);
 			if (ep) {
 				hwc_debug("rate limit %d for sync_ep#%x\n",
 					  ep->cur_rate, fp->sync_ep);
@@ -942,8 +1041,7 @@ static int hw_rule_format(struct snd_pcm_hw_params *params,
 		}
 
 		if (fp->implicit_fb) {
-			ep = get_endpoint_in_use(chip, fp->sync_ep,
-						 subs->sync_endpoint);
+			ep = sync_endpoint_in_use(fp, subs->sync_endpoint);
 			if (ep) {
 				hwc_debug("format limit %d for sync_ep#%x\n",
 					  ep->cur_format, fp->sync_ep);
@@ -1013,8 +1111,7 @@ static int hw_rule_period_size_implicit_fb(struct snd_pcm_hw_params *params,
 		}
 
 		if (fp->implicit_fb) {
-			ep = get_endpoint_in_use(chip, fp->sync_ep,
-						 subs->sync_endpoint);
+			ep = sync_endpoint_in_use(fp, subs->sync_endpoint);
 			if (ep) {
 				hwc_debug("period size limit %d for sync_ep#%x\n",
 					  ep->cur_period_frames, fp->sync_ep);
@@ -1058,8 +1155,7 @@ static int hw_rule_periods_implicit_fb(struct snd_pcm_hw_params *params,
 		}
 
 		if (fp->implicit_fb) {
-			ep = get_endpoint_in_use(chip, fp->sync_ep,
-						 subs->sync_endpoint);
+			ep = sync_endpoint_in_use(fp, subs->sync_endpoint);
 			if (ep) {
 				hwc_debug("periods limit %d for sync_ep#%x\n",
 					  ep->cur_buffer_periods, fp->sync_ep);
@@ -1246,13 +1342,14 @@ static int snd_usb_pcm_close(struct snd_pcm_substream *substream)
 	snd_media_stop_pipeline(subs);
 
 	if (!snd_usb_lock_shutdown(subs->stream->chip)) {
-		ret = snd_usb_pcm_change_state(subs, UAC3_PD_STATE_D1);
+		ret = snd_usb_pcm_idle_state(subs);
 		snd_usb_unlock_shutdown(subs->stream->chip);
 		if (ret < 0)
 			return ret;
 	}
 
 	subs->pcm_substream = NULL;
+	snd_usb_pm_linger(subs->stream->chip);
 	snd_usb_autosuspend(subs->stream->chip);
 
 	return 0;
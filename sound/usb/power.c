@@ -4,6 +4,8 @@
  */
 
 #include <linux/slab.h>
+#include <linux/delay.h>
+#include <linux/ktime.h>
 #include <linux/usb.h>
 #include <linux/usb/audio.h>
 #include <linux/usb/audio-v2.h>
@@ -86,13 +88,19 @@ int snd_usb_power_domain_set(struct snd_usb_audio *chip,
 		return err;
 	}
 
+	/*
+	 * Don't wait for the recovery here; the caller goes on with its
+	 * setup and calls snd_usb_power_domain_wait() before streaming.
+	 */
 	if (state == UAC3_PD_STATE_D0) {
 		switch (current_state) {
 		case UAC3_PD_STATE_D2:
-			udelay(pd->pd_d2d0_rec * 50);
+			pd->ready_at = ktime_add_us(ktime_get(),
+						    pd->pd_d2d0_rec * 50);
 			break;
 		case UAC3_PD_STATE_D1:
-			udelay(pd->pd_d1d0_rec * 50);
+			pd->ready_at = ktime_add_us(ktime_get(),
+						    pd->pd_d1d0_rec * 50);
 			break;
 		default:
 			return -EINVAL;
@@ -104,3 +112,41 @@ int snd_usb_power_domain_set(struct snd_usb_audio *chip,
 
 	return 0;
 }
+
+/* sleep until a pending D1/D2 -> D0 recovery has elapsed */
+void snd_usb_power_domain_wait(struct snd_usb_power_domain *pd)
+{
+	s64 us = ktime_us_delta(pd->ready_at, ktime_get());
+
+	if (us <= 0)
+		return;
+	if (us < 20000)
+		usleep_range(us, us + 100);
+	else
+		msleep(DIV_ROUND_UP(us, 1000));
+}
+
+/*
+ * Pick the power state for an idle stream: the deepest state whose
+ * recovery time (in 50us units) still fits in the start-latency budget.
+ * A budget of 0 means one period of the last configuration; without a
+ * budget, idle streams stay in D1.
+ */
+int snd_usb_power_domain_idle_state(struct snd_usb_audio *chip,
+				    struct snd_usb_power_domain *pd)
+{
+	int budget = chip->pd_budget_us;
+
+	if (budget < 0)
+		return UAC3_PD_STATE_D1;
+	if (!budget) {
+		if (!pd->period_us)
+			return UAC3_PD_STATE_D1;
+		budget = pd->period_us;
+	}
+	if (pd->pd_d2d0_rec * 50 <= budget)
+		return UAC3_PD_STATE_D2;
+	if (pd->pd_d1d0_rec * 50 <= budget)
+		return UAC3_PD_STATE_D1;
+	return UAC3_PD_STATE_D0;
+}
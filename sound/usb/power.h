@@ -6,6 +6,8 @@ struct snd_usb_power_domain {
 	int pd_id;              /* UAC3 Power Domain ID */
 	int pd_d1d0_rec;        /* D1 to D0 recovery time */
 	int pd_d2d0_rec;        /* D2 to D0 recovery time */
+	ktime_t ready_at;       /* end of the pending D0 recovery */
+	unsigned int period_us; /* last period time, for the idle policy */
 };
 
 enum {
@@ -17,6 +19,9 @@ enum {
 int snd_usb_power_domain_set(struct snd_usb_audio *chip,
 			     struct snd_usb_power_domain *pd,
 			     unsigned char state);
+void snd_usb_power_domain_wait(struct snd_usb_power_domain *pd);
+int snd_usb_power_domain_idle_state(struct snd_usb_audio *chip,
+				    struct snd_usb_power_domain *pd);
 struct snd_usb_power_domain *
 snd_usb_find_power_domain(struct usb_host_interface *ctrl_iface,
 			  unsigned char id);
@@ -24,4 +29,15 @@ snd_usb_find_power_domain(struct usb_host_interface *ctrl_iface,
 int snd_usb_autoresume(struct snd_usb_audio *chip);
 void snd_usb_autosuspend(struct snd_usb_audio *chip);
 
+/* keep-warm policies for runtime PM */
+enum {
+	SND_USB_PM_AGGRESSIVE,	/* suspend as soon as the USB core allows */
+	SND_USB_PM_WARM,	/* never autosuspend */
+	SND_USB_PM_LINGER,	/* stay resumed for a while after PCM close */
+};
+
+void snd_usb_pm_set_policy(struct snd_usb_audio *chip, int policy,
+			   unsigned int linger);
+void snd_usb_pm_linger(struct snd_usb_audio *chip);
+
 #endif /* __USBAUDIO_POWER_H */
@@ -3,6 +3,9 @@
  */
 
 #include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
 #include <linux/usb.h>
 
 #include <sound/core.h>
@@ -13,6 +16,7 @@
 #include "helper.h"
 #include "card.h"
 #include "endpoint.h"
+#include "power.h"
 #include "proc.h"
 
 /* convert our full speed USB rate into sampling rate in Hz */
@@ -46,12 +50,323 @@ static void proc_audio_usbid_read(struct snd_info_entry *entry, struct snd_info_
 			    USB_ID_PRODUCT(chip->usb_id));
 }
 
+/*
+ * quirk flags and endpoint tunables; "name value" per line for both reading
+ * and writing.  New values are picked up at the next hw_params.  Only the
+ * quirk flags evaluated at control message, hw_params, stream start/stop or
+ * suspend time can be changed; the others take effect at probe time and
+ * writes leave them untouched.
+ */
+#define QUIRK_FLAGS_RUNTIME \
+	(QUIRK_FLAG_GET_SAMPLE_RATE | QUIRK_FLAG_SKIP_CLOCK_SELECTOR | \
+	 QUIRK_FLAG_CTL_MSG_DELAY | QUIRK_FLAG_CTL_MSG_DELAY_1M | \
+	 QUIRK_FLAG_CTL_MSG_DELAY_5M | QUIRK_FLAG_IFACE_DELAY | \
+	 QUIRK_FLAG_FORCE_IFACE_RESET | QUIRK_FLAG_KEEP_IFACE_ON_AUTOSUSPEND)
+
+static void proc_audio_quirks_read(struct snd_info_entry *entry,
+				   struct snd_info_buffer *buffer)
+{
+	struct snd_usb_audio *chip = entry->private_data;
+
+	mutex_lock(&chip->mutex);
+	snd_iprintf(buffer, "quirk_flags 0x%x\n", chip->quirk_flags);
+	snd_iprintf(buffer, "# writable quirk flags 0x%x\n",
+		    QUIRK_FLAGS_RUNTIME);
+	snd_iprintf(buffer, "max_urbs %u\n", chip->tune.max_urbs);
+	snd_iprintf(buffer, "max_packs %u\n", chip->tune.max_packs);
+	snd_iprintf(buffer, "iface_delay %u\n", chip->tune.iface_delay);
+	snd_iprintf(buffer, "iface_probe %d\n", chip->tune.iface_probe);
+	snd_iprintf(buffer, "skip_packets %d\n", chip->tune.skip_packets);
+	snd_iprintf(buffer, "tenor_fb %d\n", chip->tune.tenor_fb);
+	snd_iprintf(buffer, "complete_cpu %d\n", chip->tune.complete_cpu);
+	snd_iprintf(buffer, "clock_lock_ms %u\n", chip->tune.clock_lock_ms);
+	snd_iprintf(buffer, "altset_bw %d\n", chip->tune.altset_bw);
+	snd_iprintf(buffer, "elastic_fb %d\n", chip->tune.elastic_fb);
+	snd_iprintf(buffer, "sync_batch %d\n", chip->tune.sync_batch);
+	snd_iprintf(buffer, "# iface settle last %u ms, max %u ms\n",
+		    chip->iface_settle_last, chip->iface_settle_max);
+	snd_iprintf(buffer, "# clock lock last %u ms, max %u ms, timeouts %u\n",
+		    chip->clock_lock.last_ms, chip->clock_lock.max_ms,
+		    chip->clock_lock.timeouts);
+	mutex_unlock(&chip->mutex);
+}
+
+static void proc_audio_quirks_write(struct snd_info_entry *entry,
+				    struct snd_info_buffer *buffer)
+{
+	struct snd_usb_audio *chip = entry->private_data;
+	char line[64], name[32];
+	const char *p;
+	int val;
+
+	mutex_lock(&chip->mutex);
+	while (!snd_info_get_line(buffer, line, sizeof(line))) {
+		p = snd_info_get_str(name, line, sizeof(name));
+		if (kstrtoint(skip_spaces(p), 0, &val))
+			continue;
+		if (!strcmp(name, "quirk_flags"))
+			WRITE_ONCE(chip->quirk_flags,
+				   (chip->quirk_flags & ~QUIRK_FLAGS_RUNTIME) |
+				   (val & QUIRK_FLAGS_RUNTIME));
+		/* streaming needs at least two URBs in flight; 0 = auto */
+		else if (!strcmp(name, "max_urbs") &&
+			 (val == 0 || val >= 2) && val <= MAX_URBS)
+			chip->tune.max_urbs = val;
+		else if (!strcmp(name, "max_packs") && val >= 0 &&
+			 val <= MAX_PACKS_HS)
+			chip->tune.max_packs = val;
+		else if (!strcmp(name, "iface_delay") && val >= 0 && val <= 1000)
+			chip->tune.iface_delay = val;
+		else if (!strcmp(name, "iface_probe"))
+			chip->tune.iface_probe = !!val;
+		else if (!strcmp(name, "skip_packets") && val >= -1)
+			chip->tune.skip_packets = val;
+		else if (!strcmp(name, "tenor_fb") && val >= -1 && val <= 1)
+			chip->tune.tenor_fb = val;
+		else if (!strcmp(name, "complete_cpu") && val >= -1 &&
+			 val < nr_cpu_ids)
+			chip->tune.complete_cpu = val;
+		else if (!strcmp(name, "clock_lock_ms") && val >= 0 &&
+			 val <= 10000)
+			chip->tune.clock_lock_ms = val;
+		else if (!strcmp(name, "altset_bw"))
+			chip->tune.altset_bw = !!val;
+		else if (!strcmp(name, "elastic_fb"))
+			chip->tune.elastic_fb = !!val;
+		else if (!strcmp(name, "sync_batch") && val >= -1 &&
+			 val <= MAX_SYNC_PACKS)
+			chip->tune.sync_batch = val;
+		else
+			continue;
+		usb_audio_dbg(chip, "quirks: %s set to %d\n", name, val);
+	}
+	mutex_unlock(&chip->mutex);
+}
+
+static const char * const pm_policy_names[] = {
+	[SND_USB_PM_AGGRESSIVE] = "aggressive",
+	[SND_USB_PM_WARM] = "warm",
+	[SND_USB_PM_LINGER] = "linger",
+};
+
+/* runtime PM policy and resume latency; accepts "policy <name>",
+ * "linger <seconds>" and "pd_budget <us>" (UAC3 idle state budget)
+ */
+static void proc_audio_power_read(struct snd_info_entry *entry,
+				  struct snd_info_buffer *buffer)
+{
+	struct snd_usb_audio *chip = entry->private_data;
+	struct snd_usb_pm_stats *st = &chip->pm_stats;
+
+	snd_iprintf(buffer, "policy %s\n", pm_policy_names[chip->pm_policy]);
+	snd_iprintf(buffer, "linger %u\n", chip->pm_linger);
+	snd_iprintf(buffer, "pd_budget %d\n", chip->pd_budget_us);
+	snd_iprintf(buffer, "# resumes %u, last %u us, avg %llu us, max %u us\n",
+		    st->resumes, st->last_us,
+		    st->resumes ? div_u64(st->total_us, st->resumes) : 0,
+		    st->max_us);
+}
+
+static void proc_audio_power_write(struct snd_info_entry *entry,
+				   struct snd_info_buffer *buffer)
+{
+	struct snd_usb_audio *chip = entry->private_data;
+	int policy = chip->pm_policy;
+	unsigned int linger = chip->pm_linger;
+	char line[64], name[16], val[16];
+	const char *p;
+
+	while (!snd_info_get_line(buffer, line, sizeof(line))) {
+		p = snd_info_get_str(name, line, sizeof(name));
+		snd_info_get_str(val, p, sizeof(val));
+		if (!strcmp(name, "policy")) {
+			int i = match_string(pm_policy_names,
+					     ARRAY_SIZE(pm_policy_names), val);
+			if (i >= 0)
+				policy = i;
+		} else if (!strcmp(name, "linger")) {
+			if (kstrtouint(val, 10, &linger))
+				linger = chip->pm_linger;
+		} else if (!strcmp(name, "pd_budget")) {
+			int budget;
+
+			if (!kstrtoint(val, 10, &budget) && budget >= -1)
+				chip->pd_budget_us = budget;
+		}
+	}
+	snd_usb_pm_set_policy(chip, policy, linger);
+}
+
+static const char * const xrun_reason_names[SND_USB_XRUN_REASONS] = {
+	[SND_USB_XRUN_PREPARE] = "prepare",
+	[SND_USB_XRUN_SUBMIT] = "submit",
+	[SND_USB_XRUN_FIFO] = "fifo",
+	[SND_USB_XRUN_START] = "start",
+};
+
+/* consistent copy of the xrun record of an endpoint, see record_xrun() */
+struct xrun_record {
+	unsigned int count[SND_USB_XRUN_REASONS];
+	int reason;
+	u64 time_ns;
+	unsigned int hist_len;
+	struct snd_usb_ep_event hist[EP_EVENT_HISTORY];
+};
+
+static void copy_xrun_record(struct snd_usb_endpoint *ep,
+			     struct xrun_record *rec)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&ep->hist_lock, flags);
+	memcpy(rec->count, ep->xrun_count, sizeof(rec->count));
+	rec->reason = ep->xrun_reason;
+	rec->time_ns = ep->xrun_time_ns;
+	rec->hist_len = ep->xrun_hist_len;
+	memcpy(rec->hist, ep->xrun_hist, rec->hist_len * sizeof(*rec->hist));
+	spin_unlock_irqrestore(&ep->hist_lock, flags);
+}
+
+/* xrun counters per cause and the URB history frozen at the last xrun */
+static void proc_audio_xruns_read(struct snd_info_entry *entry,
+				  struct snd_info_buffer *buffer)
+{
+	struct snd_usb_audio *chip = entry->private_data;
+	struct snd_usb_endpoint *ep;
+	struct snd_usb_ep_event *ev;
+	struct xrun_record *rec;
+	unsigned int i, total;
+
+	rec = kmalloc(sizeof(*rec), GFP_KERNEL);
+	if (!rec)
+		return;
+
+	mutex_lock(&chip->mutex);
+	list_for_each_entry(ep, &chip->ep_list, list) {
+		copy_xrun_record(ep, rec);
+		snd_iprintf(buffer, "EP 0x%02x:", ep->ep_num);
+		for (i = total = 0; i < SND_USB_XRUN_REASONS; i++) {
+			snd_iprintf(buffer, " %s %u", xrun_reason_names[i],
+				    rec->count[i]);
+			total += rec->count[i];
+		}
+		snd_iprintf(buffer, "\n");
+		if (ep->next_packet_merges)
+			snd_iprintf(buffer, "  fifo merges %u, dropped frames %u\n",
+				    ep->next_packet_merges,
+				    ep->next_packet_dropped);
+		if (!total)
+			continue;
+
+		snd_iprintf(buffer, "  last xrun: %s at %llu ns\n",
+			    xrun_reason_names[rec->reason], rec->time_ns);
+		snd_iprintf(buffer, "  %10s %4s %6s %6s %4s %4s\n",
+			    "dt(us)", "urb", "status", "length", "subm", "fifo");
+		for (i = 0; i < rec->hist_len; i++) {
+			ev = &rec->hist[i];
+			snd_iprintf(buffer, "  %10lld %4u %6d %6u %4u %4u%s\n",
+				    div_s64((s64)(ev->time_ns - rec->time_ns),
+					    NSEC_PER_USEC),
+				    ev->index, ev->status, ev->length,
+				    ev->submitted, ev->queued,
+				    ev->late ? " late" : "");
+		}
+	}
+	mutex_unlock(&chip->mutex);
+	kfree(rec);
+}
+
+/*
+ * binary dump of the endpoint snapshots, one struct snd_usb_ep_snapshot per
+ * possible EP address (unused slots are zero), read without taking locks
+ */
+static ssize_t proc_audio_ep_stats_read(struct snd_info_entry *entry,
+					void *file_private_data,
+					struct file *file, char __user *buf,
+					size_t count, loff_t pos)
+{
+	struct snd_usb_audio *chip = entry->private_data;
+	struct snd_usb_ep_snapshot snap;
+	size_t done = 0;
+
+	while (done < count) {
+		loff_t cur = pos + done;
+		unsigned int idx = cur / sizeof(snap);
+		unsigned int ofs = cur % sizeof(snap);
+		size_t len = min(count - done, sizeof(snap) - ofs);
+
+		if (idx >= ARRAY_SIZE(chip->ep_table))
+			break;
+		memset(&snap, 0, sizeof(snap));
+		if (chip->ep_table[idx])
+			snd_usb_endpoint_get_snapshot(chip->ep_table[idx], &snap);
+		if (copy_to_user(buf + done, (char *)&snap + ofs, len))
+			return -EFAULT;
+		done += len;
+	}
+	return done;
+}
+
+static const struct snd_info_entry_ops proc_audio_ep_stats_ops = {
+	.read = proc_audio_ep_stats_read,
+};
+
+/* periodic bus bandwidth reserved by the current altsettings vs. streamed */
+static void proc_audio_bandwidth_read(struct snd_info_entry *entry,
+				      struct snd_info_buffer *buffer)
+{
+	struct snd_usb_audio *chip = entry->private_data;
+	struct snd_usb_endpoint *ep;
+	unsigned int reserved, used;
+	u64 total_reserved = 0, total_used = 0;
+
+	mutex_lock(&chip->mutex);
+	list_for_each_entry(ep, &chip->ep_list, list) {
+		snd_usb_endpoint_get_bandwidth(ep, &reserved, &used);
+		if (!reserved)
+			continue;
+		snd_iprintf(buffer,
+			    "EP 0x%02x (iface %d:%d): reserved %u B/s, used %u B/s\n",
+			    ep->ep_num, ep->iface, ep->altsetting,
+			    reserved, used);
+		total_reserved += reserved;
+		total_used += used;
+	}
+	mutex_unlock(&chip->mutex);
+	snd_iprintf(buffer, "total: reserved %llu B/s, used %llu B/s\n",
+		    total_reserved, total_used);
+}
+
+static void snd_usb_audio_create_ep_stats_proc(struct snd_usb_audio *chip)
+{
+	struct snd_info_entry *entry;
+
+	if (snd_card_proc_new(chip->card, "ep_stats", &entry))
+		return;
+	entry->content = SNDRV_INFO_CONTENT_DATA;
+	entry->private_data = chip;
+	entry->c.ops = &proc_audio_ep_stats_ops;
+	/* fixed record size, ep_stats.h */
+	BUILD_BUG_ON(sizeof(struct snd_usb_ep_snapshot) != 56);
+	entry->size = ARRAY_SIZE(chip->ep_table) *
+		sizeof(struct snd_usb_ep_snapshot);
+}
+
 void snd_usb_audio_create_proc(struct snd_usb_audio *chip)
 {
 	snd_card_ro_proc_new(chip->card, "usbbus", chip,
 			     proc_audio_usbbus_read);
 	snd_card_ro_proc_new(chip->card, "usbid", chip,
 			     proc_audio_usbid_read);
+	snd_card_rw_proc_new(chip->card, "quirks", chip,
+			     proc_audio_quirks_read, proc_audio_quirks_write);
+	snd_card_rw_proc_new(chip->card, "power", chip,
+			     proc_audio_power_read, proc_audio_power_write);
+	snd_usb_audio_create_ep_stats_proc(chip);
+	snd_card_ro_proc_new(chip->card, "xruns", chip,
+			     proc_audio_xruns_read);
+	snd_card_ro_proc_new(chip->card, "bandwidth", chip,
+			     proc_audio_bandwidth_read);
 }
 
 static const char * const channel_labels[] = {
@@ -169,6 +484,28 @@ static void proc_dump_substream_formats(struct snd_usb_substream *subs, struct s
 	}
 }
 
+static void proc_dump_ep_complete(const char *name,
+				  struct snd_usb_endpoint *ep,
+				  struct snd_info_buffer *buffer)
+{
+	if (!ep->complete_count)
+		return;
+	snd_iprintf(buffer, "    %s EP completion: CPU %d%s, %u URBs, avg %llu ns, max %u ns\n",
+		    name, ep->complete_last_cpu,
+		    ep->complete_cpu >= 0 ? " (deferred)" : "",
+		    ep->complete_count,
+		    div_u64(ep->complete_total_ns, ep->complete_count),
+		    ep->complete_max_ns);
+}
+
+static void proc_dump_ep_arena(const char *name,
+			       struct snd_usb_endpoint *ep,
+			       struct snd_info_buffer *buffer)
+{
+	snd_iprintf(buffer, "    %s EP buffer: %u bytes, %u allocations, %u reuses\n",
+		    name, ep->arena_size, ep->arena_allocs, ep->arena_reuses);
+}
+
 static void proc_dump_ep_status(struct snd_usb_substream *subs,
 				struct snd_usb_endpoint *data_ep,
 				struct snd_usb_endpoint *sync_ep,
@@ -187,6 +524,17 @@ static void proc_dump_ep_status(struct snd_usb_substream *subs,
 		snd_iprintf(buffer, "    Feedback Format = %d.%d\n",
 			    (sync_ep->syncmaxsize > 3 ? 32 : 24) - res, res);
 	}
+	if (sync_ep)
+		snd_iprintf(buffer,
+			    "    Feedback = %u values, %u rejected, %d per URB\n",
+			    data_ep->fb_values, data_ep->fb_rejects,
+			    sync_ep->nurbs ? sync_ep->urb[0].packets : 0);
+	proc_dump_ep_complete("Data", data_ep, buffer);
+	if (sync_ep)
+		proc_dump_ep_complete("Sync", sync_ep, buffer);
+	proc_dump_ep_arena("Data", data_ep, buffer);
+	if (sync_ep)
+		proc_dump_ep_arena("Sync", sync_ep, buffer);
 }
 
 static void proc_dump_substream_status(struct snd_usb_audio *chip,
@@ -3,6 +3,7 @@
  */
 
 #include <linux/init.h>
+#include <linux/ktime.h>
 #include <linux/slab.h>
 #include <linux/usb.h>
 #include <linux/usb/audio.h>
@@ -549,6 +550,189 @@ int snd_usb_create_quirk(struct snd_usb_audio *chip,
  * boot quirks
  */
 
+/*
+ * Boot scripts: tables of control messages, interrupt transfers, delays and
+ * status polls, run in order by snd_usb_boot_run().  Each step is timed and
+ * logged via dev_dbg().
+ */
+enum {
+	BOOT_STEP_END,
+	BOOT_STEP_CTL_OUT,	/* control message to the device */
+	BOOT_STEP_CTL_IN,	/* control message from the device */
+	BOOT_STEP_INTR,		/* interrupt OUT message and its reply */
+	BOOT_STEP_WAIT,		/* sleep for wait_ms */
+};
+
+#define BOOT_STEP_F_MUST	(1 << 0)	/* abort the script on error */
+
+struct snd_usb_boot_step {
+	u8 type;		/* BOOT_STEP_* */
+	u8 flags;		/* BOOT_STEP_F_* */
+	u8 request;		/* CTL: bRequest */
+	u8 requesttype;		/* CTL: bmRequestType */
+	u16 value;		/* CTL: wValue; INTR: OUT endpoint */
+	u16 index;		/* CTL: wIndex; INTR: IN endpoint */
+	const u8 *data;		/* message to send */
+	u16 size;		/* message size, or reply size for CTL_IN */
+	u16 wait_ms;		/* WAIT: delay; polls: interval */
+	/* polls: repeat up to tries times until data[offset] == ready */
+	u8 tries;
+	u8 offset;
+	u8 ready;
+	u8 length;		/* if set, also the reply length must match */
+	s16 busy;		/* if >= 0, abort unless data[offset] == busy */
+};
+
+#define BOOT_BUF_SIZE	128
+
+#define BOOT_DATA(...) \
+	.data = (const u8[]){ __VA_ARGS__ }, \
+	.size = sizeof((const u8[]){ __VA_ARGS__ })
+
+#define BOOT_CTL_OUT(req, rtype, val, idx, ...) \
+	{ .type = BOOT_STEP_CTL_OUT, .request = (req), .requesttype = (rtype), \
+	  .value = (val), .index = (idx), BOOT_DATA(__VA_ARGS__) }
+#define BOOT_CTL_IN(req, rtype, val, idx, len) \
+	{ .type = BOOT_STEP_CTL_IN, .request = (req), .requesttype = (rtype), \
+	  .value = (val), .index = (idx), .size = (len) }
+#define BOOT_WAIT(ms) \
+	{ .type = BOOT_STEP_WAIT, .wait_ms = (ms) }
+#define BOOT_END \
+	{ .type = BOOT_STEP_END }
+
+static int snd_usb_boot_intr_msg(struct usb_device *dev,
+				 const struct snd_usb_boot_step *st,
+				 u8 *buf, int *length)
+{
+	int err, actual_length;
+
+	if (usb_pipe_type_check(dev, usb_sndintpipe(dev, st->value)))
+		return -EINVAL;
+	memcpy(buf, st->data, st->size);
+	err = usb_interrupt_msg(dev, usb_sndintpipe(dev, st->value), buf,
+				st->size, &actual_length, 1000);
+	if (err < 0)
+		return err;
+
+	print_hex_dump(KERN_DEBUG, "boot snd: ", DUMP_PREFIX_NONE, 16, 1,
+		       buf, actual_length, false);
+
+	memset(buf, 0, BOOT_BUF_SIZE);
+
+	if (usb_pipe_type_check(dev, usb_rcvintpipe(dev, st->index)))
+		return -EINVAL;
+	err = usb_interrupt_msg(dev, usb_rcvintpipe(dev, st->index), buf,
+				BOOT_BUF_SIZE, &actual_length, 1000);
+	if (err < 0)
+		return err;
+
+	print_hex_dump(KERN_DEBUG, "boot rcv: ", DUMP_PREFIX_NONE, 16, 1,
+		       buf, actual_length, false);
+
+	*length = actual_length;
+	return 0;
+}
+
+static int snd_usb_boot_xfer(struct usb_device *dev,
+			     const struct snd_usb_boot_step *st,
+			     u8 *buf, int *length)
+{
+	int err;
+
+	memset(buf, 0, BOOT_BUF_SIZE);
+	switch (st->type) {
+	case BOOT_STEP_CTL_OUT:
+		memcpy(buf, st->data, st->size);
+		err = snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
+				      st->request, st->requesttype,
+				      st->value, st->index, buf, st->size);
+		break;
+	case BOOT_STEP_CTL_IN:
+		err = snd_usb_ctl_msg(dev, usb_rcvctrlpipe(dev, 0),
+				      st->request, st->requesttype,
+				      st->value, st->index, buf, st->size);
+		break;
+	case BOOT_STEP_INTR:
+		return snd_usb_boot_intr_msg(dev, st, buf, length);
+	default:
+		return -EINVAL;
+	}
+	if (err >= 0)
+		*length = err;
+	return err;
+}
+
+/* run a single step; returns the number of attempts or a negative error */
+static int snd_usb_boot_step(struct usb_device *dev,
+			     const struct snd_usb_boot_step *st, u8 *buf)
+{
+	int err, length = 0;
+	int tries = 0;
+
+	if (st->type == BOOT_STEP_WAIT) {
+		msleep(st->wait_ms);
+		return 1;
+	}
+
+	for (;;) {
+		err = snd_usb_boot_xfer(dev, st, buf, &length);
+		tries++;
+		if (err < 0 && (st->flags & BOOT_STEP_F_MUST))
+			return err;
+		if (!st->tries) {
+			if (err < 0)
+				dev_dbg(&dev->dev, "boot message error: %d\n",
+					err);
+			return tries;
+		}
+		if (err >= 0) {
+			if (buf[st->offset] == st->ready &&
+			    (!st->length || length == st->length))
+				return tries;
+			if (st->busy >= 0 && buf[st->offset] != st->busy) {
+				dev_err(&dev->dev,
+					"unexpected boot response %d\n",
+					buf[st->offset]);
+				return -ENODEV;
+			}
+		}
+		if (tries >= st->tries)
+			return -ETIMEDOUT;
+		msleep(st->wait_ms);
+	}
+}
+
+static int snd_usb_boot_run(struct usb_device *dev, const char *name,
+			    const struct snd_usb_boot_step *steps)
+{
+	const struct snd_usb_boot_step *st;
+	ktime_t start = ktime_get(), t;
+	int err = 0;
+	u8 *buf;
+
+	buf = kmalloc(BOOT_BUF_SIZE, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	for (st = steps; st->type != BOOT_STEP_END; st++) {
+		t = ktime_get();
+		err = snd_usb_boot_step(dev, st, buf);
+		dev_dbg(&dev->dev, "%s boot step %td: %d, %lld us\n",
+			name, st - steps, err, ktime_us_delta(ktime_get(), t));
+		if (err < 0) {
+			dev_err(&dev->dev, "%s boot step %td failed: %d\n",
+				name, st - steps, err);
+			break;
+		}
+		err = 0;
+	}
+
+	dev_dbg(&dev->dev, "%s boot script took %lld ms\n",
+		name, ktime_ms_delta(ktime_get(), start));
+	kfree(buf);
+	return err;
+}
+
 #define EXTIGY_FIRMWARE_SIZE_OLD 794
 #define EXTIGY_FIRMWARE_SIZE_NEW 483
 
@@ -868,27 +1052,16 @@ static int snd_usb_nativeinstruments_boot_quirk(struct usb_device *dev)
 	return -EAGAIN;
 }
 
-static void mbox2_setup_48_24_magic(struct usb_device *dev)
-{
-	u8 srate[3];
-	u8 temp[12];
-
-	/* Choose 48000Hz permanently */
-	srate[0] = 0x80;
-	srate[1] = 0xbb;
-	srate[2] = 0x00;
-
-	/* Send the magic! */
-	snd_usb_ctl_msg(dev, usb_rcvctrlpipe(dev, 0),
-		0x01, 0x22, 0x0100, 0x0085, &temp, 0x0003);
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-		0x81, 0xa2, 0x0100, 0x0085, &srate, 0x0003);
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-		0x81, 0xa2, 0x0100, 0x0086, &srate, 0x0003);
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-		0x81, 0xa2, 0x0100, 0x0003, &srate, 0x0003);
-	return;
-}
+/* Choose 48000Hz permanently */
+#define MBOX2_SRATE_48K	0x80, 0xbb, 0x00
+
+static const struct snd_usb_boot_step mbox2_48_24_magic[] = {
+	BOOT_CTL_IN(0x01, 0x22, 0x0100, 0x0085, 3),
+	BOOT_CTL_OUT(0x81, 0xa2, 0x0100, 0x0085, MBOX2_SRATE_48K),
+	BOOT_CTL_OUT(0x81, 0xa2, 0x0100, 0x0086, MBOX2_SRATE_48K),
+	BOOT_CTL_OUT(0x81, 0xa2, 0x0100, 0x0003, MBOX2_SRATE_48K),
+	BOOT_END
+};
 
 /* Digidesign Mbox 2 needs to load firmware onboard
  * and driver must wait a few seconds for initialisation.
@@ -898,13 +1071,21 @@ static void mbox2_setup_48_24_magic(struct usb_device *dev)
 #define MBOX2_BOOT_LOADING     0x01 /* Hard coded into the device */
 #define MBOX2_BOOT_READY       0x02 /* Hard coded into the device */
 
+/* load the onboard firmware, polling every 0.5 seconds until it's ready */
+static const struct snd_usb_boot_step mbox2_boot[] = {
+	BOOT_WAIT(500),
+	{ .type = BOOT_STEP_CTL_IN, .request = 0x85, .requesttype = 0xc0,
+	  .value = 0x0001, .index = 0x0000, .size = 0x0012,
+	  .wait_ms = 500, .tries = 10, .offset = 0,
+	  .ready = MBOX2_BOOT_READY, .busy = MBOX2_BOOT_LOADING },
+	BOOT_END
+};
+
 static int snd_usb_mbox2_boot_quirk(struct usb_device *dev)
 {
 	struct usb_host_config *config = dev->actconfig;
 	int err;
-	u8 bootresponse[0x12];
 	int fwsize;
-	int count;
 
 	fwsize = le16_to_cpu(get_cfg_desc(config)->wTotalLength);
 
@@ -915,21 +1096,8 @@ static int snd_usb_mbox2_boot_quirk(struct usb_device *dev)
 
 	dev_dbg(&dev->dev, "Sending Digidesign Mbox 2 boot sequence...\n");
 
-	count = 0;
-	bootresponse[0] = MBOX2_BOOT_LOADING;
-	while ((bootresponse[0] == MBOX2_BOOT_LOADING) && (count < 10)) {
-		msleep(500); /* 0.5 second delay */
-		snd_usb_ctl_msg(dev, usb_rcvctrlpipe(dev, 0),
-			/* Control magic - load onboard firmware */
-			0x85, 0xc0, 0x0001, 0x0000, &bootresponse, 0x0012);
-		if (bootresponse[0] == MBOX2_BOOT_READY)
-			break;
-		dev_dbg(&dev->dev, "device not ready, resending boot sequence...\n");
-		count++;
-	}
-
-	if (bootresponse[0] != MBOX2_BOOT_READY) {
-		dev_err(&dev->dev, "Unknown bootresponse=%d, or timed out, ignoring device.\n", bootresponse[0]);
+	if (snd_usb_boot_run(dev, "Mbox 2", mbox2_boot) < 0) {
+		dev_err(&dev->dev, "Mbox 2 boot failed, ignoring device.\n");
 		return -ENODEV;
 	}
 
@@ -947,7 +1115,7 @@ static int snd_usb_mbox2_boot_quirk(struct usb_device *dev)
 	dev_dbg(&dev->dev, "mbox2_boot: new boot length = %d\n",
 		le16_to_cpu(get_cfg_desc(config)->wTotalLength));
 
-	mbox2_setup_48_24_magic(dev);
+	snd_usb_boot_run(dev, "Mbox 2 48/24", mbox2_48_24_magic);
 
 	dev_info(&dev->dev, "Digidesign Mbox 2: 24bit 48kHz");
 
@@ -984,269 +1152,142 @@ static int snd_usb_axefx3_boot_quirk(struct usb_device *dev)
 	return 0;
 }
 
-static void mbox3_setup_48_24_magic(struct usb_device *dev)
-{
-	/* The Mbox 3 is "little endian" */
-	/* max volume is: 0x0000. */
-	/* min volume is: 0x0080 (shown in little endian form) */
-
-
-	/* Load 48000Hz rate into buffer */
-	u8 com_buff[4] = {0x80, 0xbb, 0x00, 0x00};
+/*
+ * The Mbox 3 is "little endian"
+ * max volume is: 0x0000.
+ * min volume is: 0x0080 (shown in little endian form)
+ */
+#define MBOX3_SET(req, val, idx, ...) \
+	BOOT_CTL_OUT(req, 0x21, val, idx, __VA_ARGS__)
 
+static const struct snd_usb_boot_step mbox3_48_24_magic[] = {
 	/* Set 48000Hz sample rate */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			0x01, 0x21, 0x0100, 0x0001, &com_buff, 4);  //Is this really needed?
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			0x01, 0x21, 0x0100, 0x8101, &com_buff, 4);
-
-	/* Deactivate Tuner */
-	/* on  = 0x01*/
-	/* off = 0x00*/
-	com_buff[0] = 0x00;
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-		0x01, 0x21, 0x0003, 0x2001, &com_buff, 1);
-
+	MBOX3_SET(1, 0x0100, 0x0001, 0x80, 0xbb, 0x00, 0x00),
+	MBOX3_SET(1, 0x0100, 0x8101, 0x80, 0xbb, 0x00, 0x00),
+	/* Deactivate Tuner (on = 0x01, off = 0x00) */
+	MBOX3_SET(1, 0x0003, 0x2001, 0x00),
 	/* Set clock source to Internal (as opposed to S/PDIF) */
-	com_buff[0] = 0x01;
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0100, 0x8001, &com_buff, 1);
-
+	MBOX3_SET(1, 0x0100, 0x8001, 0x01),
 	/* Mute the hardware loopbacks to start the device in a known state. */
-	com_buff[0] = 0x00;
-	com_buff[1] = 0x80;
 	/* Analogue input 1 left channel: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0110, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x0110, 0x4001, 0x00, 0x80),
 	/* Analogue input 1 right channel: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0111, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x0111, 0x4001, 0x00, 0x80),
 	/* Analogue input 2 left channel: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0114, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x0114, 0x4001, 0x00, 0x80),
 	/* Analogue input 2 right channel: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0115, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x0115, 0x4001, 0x00, 0x80),
 	/* Analogue input 3 left channel: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0118, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x0118, 0x4001, 0x00, 0x80),
 	/* Analogue input 3 right channel: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0119, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x0119, 0x4001, 0x00, 0x80),
 	/* Analogue input 4 left channel: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x011c, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x011c, 0x4001, 0x00, 0x80),
 	/* Analogue input 4 right channel: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x011d, 0x4001, &com_buff, 2);
-
+	MBOX3_SET(1, 0x011d, 0x4001, 0x00, 0x80),
 	/* Set software sends to output */
-	com_buff[0] = 0x00;
-	com_buff[1] = 0x00;
 	/* Analogue software return 1 left channel: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0100, 0x4001, &com_buff, 2);
-	com_buff[0] = 0x00;
-	com_buff[1] = 0x80;
+	MBOX3_SET(1, 0x0100, 0x4001, 0x00, 0x00),
 	/* Analogue software return 1 right channel: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0101, 0x4001, &com_buff, 2);
-	com_buff[0] = 0x00;
-	com_buff[1] = 0x80;
+	MBOX3_SET(1, 0x0101, 0x4001, 0x00, 0x80),
 	/* Analogue software return 2 left channel: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0104, 0x4001, &com_buff, 2);
-	com_buff[0] = 0x00;
-	com_buff[1] = 0x00;
+	MBOX3_SET(1, 0x0104, 0x4001, 0x00, 0x80),
 	/* Analogue software return 2 right channel: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0105, 0x4001, &com_buff, 2);
-
-	com_buff[0] = 0x00;
-	com_buff[1] = 0x80;
+	MBOX3_SET(1, 0x0105, 0x4001, 0x00, 0x00),
 	/* Analogue software return 3 left channel: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0108, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x0108, 0x4001, 0x00, 0x80),
 	/* Analogue software return 3 right channel: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0109, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x0109, 0x4001, 0x00, 0x80),
 	/* Analogue software return 4 left channel: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x010c, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x010c, 0x4001, 0x00, 0x80),
 	/* Analogue software return 4 right channel: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x010d, 0x4001, &com_buff, 2);
-
+	MBOX3_SET(1, 0x010d, 0x4001, 0x00, 0x80),
 	/* Return to muting sends */
-	com_buff[0] = 0x00;
-	com_buff[1] = 0x80;
 	/* Analogue fx return left channel: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0120, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x0120, 0x4001, 0x00, 0x80),
 	/* Analogue fx return right channel: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0121, 0x4001, &com_buff, 2);
-
+	MBOX3_SET(1, 0x0121, 0x4001, 0x00, 0x80),
 	/* Analogue software input 1 fx send: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0100, 0x4201, &com_buff, 2);
+	MBOX3_SET(1, 0x0100, 0x4201, 0x00, 0x80),
 	/* Analogue software input 2 fx send: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0101, 0x4201, &com_buff, 2);
+	MBOX3_SET(1, 0x0101, 0x4201, 0x00, 0x80),
 	/* Analogue software input 3 fx send: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0102, 0x4201, &com_buff, 2);
+	MBOX3_SET(1, 0x0102, 0x4201, 0x00, 0x80),
 	/* Analogue software input 4 fx send: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0103, 0x4201, &com_buff, 2);
+	MBOX3_SET(1, 0x0103, 0x4201, 0x00, 0x80),
 	/* Analogue input 1 fx send: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0104, 0x4201, &com_buff, 2);
+	MBOX3_SET(1, 0x0104, 0x4201, 0x00, 0x80),
 	/* Analogue input 2 fx send: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0105, 0x4201, &com_buff, 2);
+	MBOX3_SET(1, 0x0105, 0x4201, 0x00, 0x80),
 	/* Analogue input 3 fx send: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0106, 0x4201, &com_buff, 2);
+	MBOX3_SET(1, 0x0106, 0x4201, 0x00, 0x80),
 	/* Analogue input 4 fx send: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0107, 0x4201, &com_buff, 2);
-
+	MBOX3_SET(1, 0x0107, 0x4201, 0x00, 0x80),
 	/* Toggle allowing host control */
-	com_buff[0] = 0x02;
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			3, 0x21, 0x0000, 0x2001, &com_buff, 1);
-
+	MBOX3_SET(3, 0x0000, 0x2001, 0x02),
 	/* Do not dim fx returns */
-	com_buff[0] = 0x00;
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			3, 0x21, 0x0002, 0x2001, &com_buff, 1);
-
+	MBOX3_SET(3, 0x0002, 0x2001, 0x00),
 	/* Do not set fx returns to mono */
-	com_buff[0] = 0x00;
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			3, 0x21, 0x0001, 0x2001, &com_buff, 1);
-
+	MBOX3_SET(3, 0x0001, 0x2001, 0x00),
 	/* Mute the S/PDIF hardware loopback
 	 * same odd volume logic here as above
 	 */
-	com_buff[0] = 0x00;
-	com_buff[1] = 0x80;
 	/* S/PDIF hardware input 1 left channel */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0112, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x0112, 0x4001, 0x00, 0x80),
 	/* S/PDIF hardware input 1 right channel */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0113, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x0113, 0x4001, 0x00, 0x80),
 	/* S/PDIF hardware input 2 left channel */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0116, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x0116, 0x4001, 0x00, 0x80),
 	/* S/PDIF hardware input 2 right channel */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0117, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x0117, 0x4001, 0x00, 0x80),
 	/* S/PDIF hardware input 3 left channel */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x011a, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x011a, 0x4001, 0x00, 0x80),
 	/* S/PDIF hardware input 3 right channel */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x011b, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x011b, 0x4001, 0x00, 0x80),
 	/* S/PDIF hardware input 4 left channel */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x011e, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x011e, 0x4001, 0x00, 0x80),
 	/* S/PDIF hardware input 4 right channel */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x011f, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x011f, 0x4001, 0x00, 0x80),
 	/* S/PDIF software return 1 left channel */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0102, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x0102, 0x4001, 0x00, 0x80),
 	/* S/PDIF software return 1 right channel */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0103, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x0103, 0x4001, 0x00, 0x80),
 	/* S/PDIF software return 2 left channel */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0106, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x0106, 0x4001, 0x00, 0x80),
 	/* S/PDIF software return 2 right channel */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0107, 0x4001, &com_buff, 2);
-
-	com_buff[0] = 0x00;
-	com_buff[1] = 0x00;
+	MBOX3_SET(1, 0x0107, 0x4001, 0x00, 0x80),
 	/* S/PDIF software return 3 left channel */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x010a, 0x4001, &com_buff, 2);
-
-	com_buff[0] = 0x00;
-	com_buff[1] = 0x80;
+	MBOX3_SET(1, 0x010a, 0x4001, 0x00, 0x00),
 	/* S/PDIF software return 3 right channel */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x010b, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x010b, 0x4001, 0x00, 0x80),
 	/* S/PDIF software return 4 left channel */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x010e, 0x4001, &com_buff, 2);
-
-	com_buff[0] = 0x00;
-	com_buff[1] = 0x00;
+	MBOX3_SET(1, 0x010e, 0x4001, 0x00, 0x80),
 	/* S/PDIF software return 4 right channel */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x010f, 0x4001, &com_buff, 2);
-
-	com_buff[0] = 0x00;
-	com_buff[1] = 0x80;
+	MBOX3_SET(1, 0x010f, 0x4001, 0x00, 0x00),
 	/* S/PDIF fx returns left channel */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0122, 0x4001, &com_buff, 2);
+	MBOX3_SET(1, 0x0122, 0x4001, 0x00, 0x80),
 	/* S/PDIF fx returns right channel */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0123, 0x4001, &com_buff, 2);
-
-	/* Set the dropdown "Effect" to the first option */
-	/* Room1  = 0x00 */
-	/* Room2  = 0x01 */
-	/* Room3  = 0x02 */
-	/* Hall 1 = 0x03 */
-	/* Hall 2 = 0x04 */
-	/* Plate  = 0x05 */
-	/* Delay  = 0x06 */
-	/* Echo   = 0x07 */
-	com_buff[0] = 0x00;
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0200, 0x4301, &com_buff, 1);	/* max is 0xff */
-	/* min is 0x00 */
-
-
-	/* Set the effect duration to 0 */
-	/* max is 0xffff */
-	/* min is 0x0000 */
-	com_buff[0] = 0x00;
-	com_buff[1] = 0x00;
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0400, 0x4301, &com_buff, 2);
-
-	/* Set the effect volume and feedback to 0 */
-	/* max is 0xff */
-	/* min is 0x00 */
-	com_buff[0] = 0x00;
+	MBOX3_SET(1, 0x0123, 0x4001, 0x00, 0x80),
+	/* Set the dropdown "Effect" to the first option:
+	 * Room1 = 0x00, Room2 = 0x01, Room3 = 0x02, Hall 1 = 0x03,
+	 * Hall 2 = 0x04, Plate = 0x05, Delay = 0x06, Echo = 0x07
+	 */
+	MBOX3_SET(1, 0x0200, 0x4301, 0x00),
+	/* Set the effect duration to 0 (0x0000 - 0xffff) */
+	MBOX3_SET(1, 0x0400, 0x4301, 0x00, 0x00),
+	/* Set the effect volume and feedback to 0 (0x00 - 0xff) */
 	/* feedback: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0500, 0x4301, &com_buff, 1);
+	MBOX3_SET(1, 0x0500, 0x4301, 0x00),
 	/* volume: */
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			1, 0x21, 0x0300, 0x4301, &com_buff, 1);
-
-	/* Set soft button hold duration */
-	/* 0x03 = 250ms */
-	/* 0x05 = 500ms DEFAULT */
-	/* 0x08 = 750ms */
-	/* 0x0a = 1sec */
-	com_buff[0] = 0x05;
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			3, 0x21, 0x0005, 0x2001, &com_buff, 1);
-
+	MBOX3_SET(1, 0x0300, 0x4301, 0x00),
+	/* Set soft button hold duration:
+	 * 0x03 = 250ms, 0x05 = 500ms (default), 0x08 = 750ms, 0x0a = 1sec
+	 */
+	MBOX3_SET(3, 0x0005, 0x2001, 0x05),
 	/* Use dim LEDs for button of state */
-	com_buff[0] = 0x00;
-	snd_usb_ctl_msg(dev, usb_sndctrlpipe(dev, 0),
-			3, 0x21, 0x0004, 0x2001, &com_buff, 1);
-}
+	MBOX3_SET(3, 0x0004, 0x2001, 0x00),
+	BOOT_END
+};
 
 #define MBOX3_DESCRIPTOR_SIZE	464
 
@@ -1277,119 +1318,56 @@ static int snd_usb_mbox3_boot_quirk(struct usb_device *dev)
 	dev_dbg(&dev->dev, "mbox3_boot: new boot length = %d\n",
 		le16_to_cpu(get_cfg_desc(config)->wTotalLength));
 
-	mbox3_setup_48_24_magic(dev);
+	snd_usb_boot_run(dev, "Mbox 3 48/24", mbox3_48_24_magic);
 	dev_info(&dev->dev, "Digidesign Mbox 3: 24bit 48kHz");
 
 	return 0; /* Successful boot */
 }
 
-#define MICROBOOK_BUF_SIZE 128
-
-static int snd_usb_motu_microbookii_communicate(struct usb_device *dev, u8 *buf,
-						int buf_size, int *length)
-{
-	int err, actual_length;
-
-	if (usb_pipe_type_check(dev, usb_sndintpipe(dev, 0x01)))
-		return -EINVAL;
-	err = usb_interrupt_msg(dev, usb_sndintpipe(dev, 0x01), buf, *length,
-				&actual_length, 1000);
-	if (err < 0)
-		return err;
-
-	print_hex_dump(KERN_DEBUG, "MicroBookII snd: ", DUMP_PREFIX_NONE, 16, 1,
-		       buf, actual_length, false);
-
-	memset(buf, 0, buf_size);
-
-	if (usb_pipe_type_check(dev, usb_rcvintpipe(dev, 0x82)))
-		return -EINVAL;
-	err = usb_interrupt_msg(dev, usb_rcvintpipe(dev, 0x82), buf, buf_size,
-				&actual_length, 1000);
-	if (err < 0)
-		return err;
-
-	print_hex_dump(KERN_DEBUG, "MicroBookII rcv: ", DUMP_PREFIX_NONE, 16, 1,
-		       buf, actual_length, false);
-
-	*length = actual_length;
-	return 0;
-}
+/*
+ * First tell the MicroBook II which sample rate to use, then poll every
+ * 100 ms until the device informs of its readiness through a message of
+ * the form
+ *           XX 06 00 00 00 00 0b 18  00 00 00 01
+ * If the device is not yet ready to accept audio data, the last byte of
+ * that sequence is 00.
+ */
+static const struct snd_usb_boot_step motu_microbookii_boot[] = {
+	{ .type = BOOT_STEP_INTR, .flags = BOOT_STEP_F_MUST,
+	  .value = 0x01, .index = 0x82,
+	  BOOT_DATA(0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0b, 0x14,
+		    0x00, 0x00, 0x00, 0x01) },
+	{ .type = BOOT_STEP_INTR, .flags = BOOT_STEP_F_MUST,
+	  .value = 0x01, .index = 0x82,
+	  BOOT_DATA(0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x0b, 0x18),
+	  .wait_ms = 100, .tries = 100, .offset = 11, .ready = 1,
+	  .length = 12, .busy = -1 },
+	BOOT_END
+};
 
 static int snd_usb_motu_microbookii_boot_quirk(struct usb_device *dev)
 {
-	int err, actual_length, poll_attempts = 0;
-	static const u8 set_samplerate_seq[] = { 0x00, 0x00, 0x00, 0x00,
-						 0x00, 0x00, 0x0b, 0x14,
-						 0x00, 0x00, 0x00, 0x01 };
-	static const u8 poll_ready_seq[] = { 0x00, 0x04, 0x00, 0x00,
-					     0x00, 0x00, 0x0b, 0x18 };
-	u8 *buf = kzalloc(MICROBOOK_BUF_SIZE, GFP_KERNEL);
-
-	if (!buf)
-		return -ENOMEM;
+	int err;
 
 	dev_info(&dev->dev, "Waiting for MOTU Microbook II to boot up...\n");
 
-	/* First we tell the device which sample rate to use. */
-	memcpy(buf, set_samplerate_seq, sizeof(set_samplerate_seq));
-	actual_length = sizeof(set_samplerate_seq);
-	err = snd_usb_motu_microbookii_communicate(dev, buf, MICROBOOK_BUF_SIZE,
-						   &actual_length);
-
-	if (err < 0) {
-		dev_err(&dev->dev,
-			"failed setting the sample rate for Motu MicroBook II: %d\n",
-			err);
-		goto free_buf;
-	}
-
-	/* Then we poll every 100 ms until the device informs of its readiness. */
-	while (true) {
-		if (++poll_attempts > 100) {
-			dev_err(&dev->dev,
-				"failed booting Motu MicroBook II: timeout\n");
-			err = -ENODEV;
-			goto free_buf;
-		}
-
-		memset(buf, 0, MICROBOOK_BUF_SIZE);
-		memcpy(buf, poll_ready_seq, sizeof(poll_ready_seq));
-
-		actual_length = sizeof(poll_ready_seq);
-		err = snd_usb_motu_microbookii_communicate(
-			dev, buf, MICROBOOK_BUF_SIZE, &actual_length);
-		if (err < 0) {
-			dev_err(&dev->dev,
-				"failed booting Motu MicroBook II: communication error %d\n",
-				err);
-			goto free_buf;
-		}
-
-		/* the device signals its readiness through a message of the
-		 * form
-		 *           XX 06 00 00 00 00 0b 18  00 00 00 01
-		 * If the device is not yet ready to accept audio data, the
-		 * last byte of that sequence is 00.
-		 */
-		if (actual_length == 12 && buf[actual_length - 1] == 1)
-			break;
-
-		msleep(100);
-	}
-
-	dev_info(&dev->dev, "MOTU MicroBook II ready\n");
-
-free_buf:
-	kfree(buf);
+	err = snd_usb_boot_run(dev, "MicroBook II", motu_microbookii_boot);
+	if (err == -ETIMEDOUT)
+		err = -ENODEV;
+	if (!err)
+		dev_info(&dev->dev, "MOTU MicroBook II ready\n");
 	return err;
 }
 
+/* the M Series needs some time after enumeration before it's usable */
+static const struct snd_usb_boot_step motu_m_series_boot[] = {
+	BOOT_WAIT(2000),
+	BOOT_END
+};
+
 static int snd_usb_motu_m_series_boot_quirk(struct usb_device *dev)
 {
-	msleep(2000);
-
-	return 0;
+	return snd_usb_boot_run(dev, "M Series", motu_m_series_boot);
 }
 
 /*
@@ -1825,6 +1803,12 @@ void snd_usb_endpoint_start_quirk(struct snd_usb_endpoint *ep)
 	     ep->chip->usb_id == USB_ID(0x1852, 0x5034)) && /* T+A Dac8 */
 	    ep->syncmaxsize == 4)
 		ep->tenor_fb_quirk = 1;
+
+	/* overrides from the proc "quirks" file */
+	if (ep->chip->tune.skip_packets >= 0)
+		ep->skip_packets = ep->chip->tune.skip_packets;
+	if (ep->chip->tune.tenor_fb >= 0)
+		ep->tenor_fb_quirk = ep->chip->tune.tenor_fb;
 }
 
 /* quirk applied after snd_usb_ctl_msg(); not applied during boot quirks */
@@ -2073,6 +2057,8 @@ static const struct usb_audio_quirk_flags_table quirk_flags_table[] = {
 		   QUIRK_FLAG_GENERIC_IMPLICIT_FB),
 	DEVICE_FLG(0x0763, 0x2031, /* M-Audio Fast Track C600 */
 		   QUIRK_FLAG_GENERIC_IMPLICIT_FB),
+	DEVICE_FLG(0x07fd, 0x0004, /* MOTU MicroBook IIc */
+		   QUIRK_FLAG_VALIDATE_RATES | QUIRK_FLAG_CLOCK_LOCK_WAIT),
 	DEVICE_FLG(0x08bb, 0x2702, /* LineX FM Transmitter */
 		   QUIRK_FLAG_IGNORE_CTL_ERROR),
 	DEVICE_FLG(0x0951, 0x16ad, /* Kingston HyperX */
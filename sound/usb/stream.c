@@ -107,9 +107,9 @@ static void snd_usb_init_substream(struct snd_usb_stream *as,
 
 	if (pd) {
 		subs->str_pd = pd;
-		/* Initialize Power Domain to idle status D1 */
+		/* Initialize Power Domain to its idle state */
 		snd_usb_power_domain_set(subs->stream->chip, pd,
-					 UAC3_PD_STATE_D1);
+			snd_usb_power_domain_idle_state(subs->stream->chip, pd));
 	}
 
 	snd_usb_preallocate_buffer(subs);
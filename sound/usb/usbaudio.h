@@ -39,6 +39,7 @@ struct snd_usb_audio {
 	int num_interfaces;
 	int last_iface;
 	int num_suspended_intf;
+	int resume_err;			/* error from async mixer resume */
 	int sample_rate_read_error;
 
 	int badd_profile;		/* UAC3 BADD profile */
@@ -47,6 +48,12 @@ struct snd_usb_audio {
 	struct list_head ep_list;	/* list of audio-related endpoints */
 	struct list_head iface_ref_list; /* list of interface refcounts */
 	struct list_head clock_ref_list; /* list of clock refcounts */
+	spinlock_t ctl_cache_lock;
+	struct list_head ctl_cache;	/* see snd_usb_ctl_msg_cached() */
+	/* direct lookup tables for the above, by EP address, iface and clock */
+	struct snd_usb_endpoint *ep_table[32];
+	struct snd_usb_iface_ref *iface_ref_table[256];
+	struct snd_usb_clock_ref *clock_ref_table[256];
 	int pcm_devs;
 
 	unsigned int num_rawmidis;	/* number of created rawmidi devices */
@@ -60,6 +67,54 @@ struct snd_usb_audio {
 	bool autoclock;			/* from the 'autoclock' module param */
 
 	bool lowlatency;		/* from the 'lowlatency' module param */
+
+	/* runtime tunables via proc "quirks"; applied at the next hw_params */
+	struct snd_usb_tunables {
+		unsigned int max_urbs;		/* URBs per data EP, 0 = auto */
+		unsigned int max_packs;		/* packets per URB, 0 = auto */
+		unsigned int iface_delay;	/* ms, for QUIRK_FLAG_IFACE_DELAY */
+		bool iface_probe;		/* end iface_delay at clock valid */
+		int skip_packets;		/* skipped at EP start, -1 = quirk */
+		int tenor_fb;			/* tenor_fb_quirk, -1 = quirk */
+		int complete_cpu;		/* deferred completion, -1 = off */
+		unsigned int clock_lock_ms;	/* clock lock timeout, 0 = none */
+		bool altset_bw;			/* pick the smallest fitting altset, opt-in */
+		bool elastic_fb;		/* fold implicit fb ring overflows, opt-in */
+		int sync_batch;			/* feedback packets per URB, -1 = auto */
+	} tune;
+	unsigned int iface_settle_last;	/* measured settle time in ms */
+	unsigned int iface_settle_max;
+
+	/* clock lock waiter, see snd_usb_clock_wait_lock() */
+	struct snd_usb_clock_lock {
+		struct mutex mutex;
+		struct delayed_work work;
+		struct completion done;
+		const struct audioformat *fmt;
+		int clock;
+		ktime_t start;
+		unsigned int interval;		/* ms, doubled on each poll */
+		unsigned int timeout;		/* ms */
+		int result;
+		unsigned int last_ms;		/* statistics */
+		unsigned int max_ms;
+		unsigned int timeouts;
+	} clock_lock;
+
+	/* keep-warm policy, see snd_usb_pm_set_policy() */
+	struct mutex pm_mutex;
+	int pm_policy;			/* SND_USB_PM_* */
+	unsigned int pm_linger;		/* seconds to stay resumed after close */
+	int pd_budget_us;		/* UAC3 idle policy, -1 = always D1 */
+	bool pm_held;			/* autopm reference held by the policy */
+	struct delayed_work pm_linger_work;
+	struct snd_usb_pm_stats {
+		unsigned int resumes;	/* resumes from runtime suspend */
+		u64 total_us;
+		unsigned int last_us;
+		unsigned int max_us;
+	} pm_stats;
+
 	struct usb_host_interface *ctrl_intf;	/* the audio control interface */
 	struct media_device *media_dev;
 	struct media_intf_devnode *ctl_intf_media_devnode;
@@ -129,6 +184,7 @@ void snd_usb_unlock_shutdown(struct snd_usb_audio *chip);
 
 extern bool snd_usb_use_vmalloc;
 extern bool snd_usb_skip_validation;
+extern unsigned int snd_usb_reprobe_cache_secs;
 
 /*
  * Driver behavior quirk flags, stored in chip->quirk_flags
@@ -182,6 +238,12 @@ extern bool snd_usb_skip_validation;
  * QUIRK_FLAG_FIXED_RATE
  *  Do not set PCM rate (frequency) when only one rate is available
  *  for the given endpoint.
+ * QUIRK_FLAG_CLOCK_LOCK_WAIT
+ *  Wait up to 5 seconds for the clock to become valid after a sample rate
+ *  change instead of failing right away
+ * QUIRK_FLAG_KEEP_IFACE_ON_AUTOSUSPEND
+ *  Keep the interface and clock setup across a runtime autosuspend; only
+ *  for devices known to retain their altset and rate while suspended
  */
 
 #define QUIRK_FLAG_GET_SAMPLE_RATE	(1U << 0)
@@ -206,5 +268,7 @@ extern bool snd_usb_skip_validation;
 #define QUIRK_FLAG_IFACE_SKIP_CLOSE	(1U << 19)
 #define QUIRK_FLAG_FORCE_IFACE_RESET	(1U << 20)
 #define QUIRK_FLAG_FIXED_RATE		(1U << 21)
+#define QUIRK_FLAG_CLOCK_LOCK_WAIT	(1U << 22)
+#define QUIRK_FLAG_KEEP_IFACE_ON_AUTOSUSPEND	(1U << 23)
 
 #endif /* __USBAUDIO_H */
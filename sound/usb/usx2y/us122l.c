@@ -9,6 +9,7 @@
 #include <linux/module.h>
 #include <sound/core.h>
 #include <sound/hwdep.h>
+#include <sound/info.h>
 #include <sound/pcm.h>
 #include <sound/initval.h>
 #define MODNAME "US122L"
@@ -437,6 +438,22 @@ static int usb_stream_hwdep_new(struct snd_card *card)
 	return 0;
 }
 
+static void us122l_proc_read(struct snd_info_entry *entry,
+			     struct snd_info_buffer *buffer)
+{
+	struct us122l *us122l = entry->private_data;
+	struct usb_stream_kernel *sk = &us122l->sk;
+
+	mutex_lock(&us122l->mutex);
+	snd_iprintf(buffer, "State: %i\n", sk->s ? sk->s->state : -1);
+	snd_iprintf(buffer, "Starts: %u (failed %u, retries %u)\n",
+		    sk->start_count, sk->start_failed, sk->start_retries);
+	snd_iprintf(buffer, "Last start: %u us, %u tries\n",
+		    sk->start_last_us, sk->start_last_tries);
+	snd_iprintf(buffer, "Max start: %u us\n", sk->start_max_us);
+	mutex_unlock(&us122l->mutex);
+}
+
 static bool us122l_create_card(struct snd_card *card)
 {
 	int err;
@@ -479,6 +496,7 @@ static bool us122l_create_card(struct snd_card *card)
 
 		goto stop;
 	}
+	snd_card_ro_proc_new(card, "stream", us122l, us122l_proc_read);
 	return true;
 
 stop:
@@ -244,6 +244,8 @@ int usx2y_hwdep_new(struct snd_card *card, struct usb_device *device)
 		return -ENOMEM;
 	memset(us428->us428ctls_sharedmem, -1, US428_SHAREDMEM_PAGES);
 	us428->us428ctls_sharedmem->ctl_snapshot_last = -2;
+	us428->us428ctls_sharedmem->p4out_dropped = 0;
+	us428->us428ctls_sharedmem->p4out_merged = 0;
 
 	return 0;
 }
@@ -5,6 +5,7 @@
 
 #include <linux/usb.h>
 #include <linux/gfp.h>
+#include <linux/ktime.h>
 
 #include "usb_stream.h"
 
@@ -240,6 +241,13 @@ out:
 
 /*                             start                                  */
 
+/* give up on this start attempt and wake up usb_stream_start() */
+static void start_failed(struct usb_stream_kernel *sk)
+{
+	sk->s->state = usb_stream_xrun;
+	complete_all(&sk->started);
+}
+
 static bool balance_check(struct usb_stream_kernel *sk, struct urb *urb)
 {
 	bool r;
@@ -248,6 +256,8 @@ static bool balance_check(struct usb_stream_kernel *sk, struct urb *urb)
 		if (urb->status != -ESHUTDOWN && urb->status != -ENOENT)
 			snd_printk(KERN_WARNING "status=%i\n", urb->status);
 		sk->iso_frame_balance = 0x7FFFFFFF;
+		if (sk->s->state < usb_stream_ready)
+			start_failed(sk);
 		return false;
 	}
 	r = sk->iso_frame_balance == 0;
@@ -595,20 +605,24 @@ static void stream_start(struct usb_stream_kernel *sk,
 		s->insize_done += urb_size;
 
 		if (usb_stream_prepare_playback(sk, inurb) < 0)
-			return;
+			goto err_out;
 
 	} else
 		playback_prep_freqn(sk, sk->idle_outurb);
 
 	if (submit_urbs(sk, inurb, outurb) < 0)
-		return;
+		goto err_out;
 
 	if (s->state == usb_stream_sync1 && s->insize_done > 360000) {
 		/* just guesswork                            ^^^^^^ */
 		s->state = usb_stream_ready;
 		subs_set_complete(sk->inurb, i_capture_idle);
 		subs_set_complete(sk->outurb, i_playback_idle);
+		complete_all(&sk->started);
 	}
+	return;
+err_out:
+	start_failed(sk);
 }
 
 static void i_capture_start(struct urb *urb)
@@ -620,7 +634,9 @@ static void i_capture_start(struct urb *urb)
 	int empty = 0;
 
 	if (urb->status) {
-		snd_printk(KERN_WARNING "status=%i\n", urb->status);
+		if (urb->status != -ESHUTDOWN && urb->status != -ENOENT)
+			snd_printk(KERN_WARNING "status=%i\n", urb->status);
+		start_failed(sk);
 		return;
 	}
 
@@ -631,6 +647,7 @@ static void i_capture_start(struct urb *urb)
 			++empty;
 			if (s->state >= usb_stream_sync0) {
 				snd_printk(KERN_WARNING "%i\n", l);
+				start_failed(sk);
 				return;
 			}
 		}
@@ -667,27 +684,17 @@ static void i_playback_start(struct urb *urb)
 		stream_start(sk, sk->i_urb, urb);
 }
 
-int usb_stream_start(struct usb_stream_kernel *sk)
+/*
+ * Submit the first in/out URB pairs right after a frame boundary, so that
+ * both pairs usually get queued within the same (micro)frame and thus share
+ * their start_frame; -EAGAIN tells the caller to retry if they don't.
+ */
+static int usb_stream_submit_start(struct usb_stream_kernel *sk)
 {
-	struct usb_stream *s = sk->s;
-	int frame = 0, iters = 0;
-	int u, err;
-	int try = 0;
-
-	if (s->state != usb_stream_stopped)
-		return -EAGAIN;
+	struct usb_device *dev = sk->inurb[0]->dev;
+	int frame, now, iters = 0;
+	int u, err = 0;
 
-	subs_set_complete(sk->inurb, i_capture_start);
-	subs_set_complete(sk->outurb, i_playback_start);
-	memset(sk->write_page, 0, s->write_size);
-dotry:
-	s->insize_done = 0;
-	s->idle_insize = 0;
-	s->idle_outsize = 0;
-	s->sync_packet = -1;
-	s->inpacket_head = -1;
-	sk->iso_frame_balance = 0;
-	++try;
 	for (u = 0; u < 2; u++) {
 		struct urb *inurb = sk->inurb[u];
 		struct urb *outurb = sk->outurb[u];
@@ -697,43 +704,74 @@ dotry:
 		inurb->transfer_buffer_length =
 			inurb->number_of_packets *
 			inurb->iso_frame_desc[0].length;
+	}
 
-		if (u == 0) {
-			int now;
-			struct usb_device *dev = inurb->dev;
+	frame = usb_get_current_frame_number(dev);
+	do {
+		now = usb_get_current_frame_number(dev);
+		++iters;
+	} while (now > -1 && now == frame);
 
-			frame = usb_get_current_frame_number(dev);
-			do {
-				now = usb_get_current_frame_number(dev);
-				++iters;
-			} while (now > -1 && now == frame);
-		}
-		err = usb_submit_urb(inurb, GFP_ATOMIC);
+	for (u = 0; u < 2; u++) {
+		err = usb_submit_urb(sk->inurb[u], GFP_ATOMIC);
 		if (err < 0) {
 			snd_printk(KERN_ERR
 				   "usb_submit_urb(sk->inurb[%i]) returned %i\n",
 				   u, err);
-			return err;
+			break;
 		}
-		err = usb_submit_urb(outurb, GFP_ATOMIC);
+		err = usb_submit_urb(sk->outurb[u], GFP_ATOMIC);
 		if (err < 0) {
 			snd_printk(KERN_ERR
 				   "usb_submit_urb(sk->outurb[%i]) returned %i\n",
 				   u, err);
-			return err;
+			break;
 		}
+	}
+	if (err < 0)
+		return err;
 
-		if (inurb->start_frame != outurb->start_frame) {
+	snd_printdd(KERN_DEBUG "%i %i\n", frame, iters);
+	for (u = 0; u < 2; u++) {
+		if (sk->inurb[u]->start_frame != sk->outurb[u]->start_frame) {
 			snd_printd(KERN_DEBUG
 				   "u[%i] start_frames differ in:%u out:%u\n",
-				   u, inurb->start_frame, outurb->start_frame);
-			goto check_retry;
+				   u, sk->inurb[u]->start_frame,
+				   sk->outurb[u]->start_frame);
+			return -EAGAIN;
 		}
 	}
-	snd_printdd(KERN_DEBUG "%i %i\n", frame, iters);
-	try = 0;
-check_retry:
-	if (try) {
+	return 0;
+}
+
+int usb_stream_start(struct usb_stream_kernel *sk)
+{
+	struct usb_stream *s = sk->s;
+	ktime_t begin;
+	unsigned int us;
+	int err;
+	int try = 0;
+
+	if (s->state != usb_stream_stopped)
+		return -EAGAIN;
+
+	begin = ktime_get();
+	memset(sk->write_page, 0, s->write_size);
+dotry:
+	subs_set_complete(sk->inurb, i_capture_start);
+	subs_set_complete(sk->outurb, i_playback_start);
+	init_completion(&sk->started);
+	s->state = usb_stream_stopped;
+	s->insize_done = 0;
+	s->idle_insize = 0;
+	s->idle_outsize = 0;
+	s->sync_packet = -1;
+	s->inpacket_head = -1;
+	sk->iso_frame_balance = 0;
+	++try;
+
+	err = usb_stream_submit_start(sk);
+	if (err == -EAGAIN) {
 		usb_stream_stop(sk);
 		if (try < 5) {
 			msleep(1500);
@@ -742,26 +780,35 @@ check_retry:
 		}
 		snd_printk(KERN_WARNING
 			   "couldn't start all urbs on the same start_frame.\n");
-		return -EFAULT;
+		err = -EFAULT;
+		goto out;
 	}
+	if (err < 0)
+		goto out;
 
 	sk->idle_inurb = sk->inurb[USB_STREAM_NURBS - 2];
 	sk->idle_outurb = sk->outurb[USB_STREAM_NURBS - 2];
 	sk->completed_inurb = sk->inurb[USB_STREAM_NURBS - 1];
 	sk->completed_outurb = sk->outurb[USB_STREAM_NURBS - 1];
 
-/* wait, check */
-	{
-		int wait_ms = 3000;
-
-		while (s->state != usb_stream_ready && wait_ms > 0) {
-			snd_printdd(KERN_DEBUG "%i\n", s->state);
-			msleep(200);
-			wait_ms -= 200;
-		}
-	}
+	/* signalled by stream_start() or on any failure while syncing */
+	if (!wait_for_completion_timeout(&sk->started,
+					 msecs_to_jiffies(3000)))
+		snd_printk(KERN_WARNING "start timed out, state %i\n",
+			   s->state);
+	err = s->state == usb_stream_ready ? 0 : -EFAULT;
 
-	return s->state == usb_stream_ready ? 0 : -EFAULT;
+out:
+	us = ktime_to_us(ktime_sub(ktime_get(), begin));
+	sk->start_count++;
+	sk->start_retries += try - 1;
+	sk->start_last_tries = try;
+	sk->start_last_us = us;
+	if (err < 0)
+		sk->start_failed++;
+	else if (us > sk->start_max_us)
+		sk->start_max_us = us;
+	return err;
 }
 
 
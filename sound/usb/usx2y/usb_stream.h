@@ -2,6 +2,7 @@
 #ifndef __USB_STREAM_H
 #define __USB_STREAM_H
 
+#include <linux/completion.h>
 #include <uapi/sound/usb_stream.h>
 
 #define USB_STREAM_NURBS 4
@@ -25,6 +26,15 @@ struct usb_stream_kernel {
 	int iso_frame_balance;
 
 	wait_queue_head_t sleep;
+	struct completion started;	/* ready or failed during start */
+
+	/* start-up statistics */
+	unsigned int start_count;
+	unsigned int start_failed;
+	unsigned int start_retries;
+	unsigned int start_last_tries;
+	unsigned int start_last_us;
+	unsigned int start_max_us;
 
 	unsigned int out_phase;
 	unsigned int out_phase_peeked;
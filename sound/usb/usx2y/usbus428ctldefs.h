@@ -88,6 +88,9 @@ struct us428ctls_sharedmem {
 	int			ctl_snapshot_last, ctl_snapshot_red;
 	struct us428_p4out	p4out[N_US428_P4OUT_BUFS];
 	int			p4out_last, p4out_sent;
+	/* appended; older userspace doesn't look at these */
+	int			p4out_dropped;	/* entries the kernel failed to send */
+	int			p4out_merged;	/* entries folded into a later one */
 };
 
 #define US428_SHAREDMEM_PAGES	PAGE_ALIGN(sizeof(struct us428ctls_sharedmem))
@@ -152,20 +152,119 @@ static void snd_usx2y_card_private_free(struct snd_card *card);
 static void usx2y_unlinkseq(struct snd_usx2y_async_seq *s);
 
 /*
- * pipe 4 is used for switching the lamps, setting samplerate, volumes ....
+ * Fold @next into @cmd when @next only overrides what @cmd carries anyway:
+ * a volume for the same channel, or lights on offsets @cmd already sets.
  */
-static void i_usx2y_out04_int(struct urb *urb)
+static bool usx2y_p4out_merge(struct us428_p4out *cmd,
+			      const struct us428_p4out *next)
 {
-#ifdef CONFIG_SND_DEBUG
-	if (urb->status) {
-		int i;
-		struct usx2ydev *usx2y = urb->context;
+	struct us428_set_byte *light = cmd->val.lights.light;
+	const struct us428_set_byte *nlight = next->val.lights.light;
+	int i, j, n = ARRAY_SIZE(cmd->val.lights.light);
+
+	if (cmd->type != next->type)
+		return false;
+	if (cmd->type != ELT_LIGHT) {
+		if (cmd->val.vol.channel != next->val.vol.channel)
+			return false;
+		cmd->val.vol = next->val.vol;
+		return true;
+	}
 
-		for (i = 0; i < 10 && usx2y->as04.urb[i] != urb; i++)
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < n && light[j].offset != nlight[i].offset; j++)
 			;
-		snd_printdd("%s urb %i status=%i\n", __func__, i, urb->status);
+		if (j == n)
+			return false;
 	}
-#endif
+	for (i = 0; i < n; i++)
+		for (j = 0; j < n; j++)
+			if (light[j].offset == nlight[i].offset)
+				light[j].value = nlight[i].value;
+	return true;
+}
+
+/*
+ * Send all p4out entries userspace has queued in the shared memory, as long
+ * as there are free urbs.  Called from both pipe 4 completions, so pending
+ * entries don't wait for the next in04 interrupt and none are skipped.
+ */
+static void usx2y_p4out_flush(struct usx2ydev *usx2y)
+{
+	struct us428ctls_sharedmem *us428ctls = usx2y->us428ctls_sharedmem;
+	struct snd_usx2y_async_seq *as = &usx2y->as04;
+	struct us428_p4out cmd;
+	unsigned long flags;
+	int last, send, next, len, i, err;
+
+	if (!us428ctls)
+		return;
+
+	spin_lock_irqsave(&as->lock, flags);
+	while (as->buffer && !as->stopped && !usx2y->us04) {
+		last = READ_ONCE(us428ctls->p4out_last);
+		if (last < 0 || last >= N_US428_P4OUT_BUFS ||
+		    last == us428ctls->p4out_sent)
+			break;
+		i = find_first_zero_bit(&as->busy, URBS_ASYNC_SEQ);
+		if (i >= URBS_ASYNC_SEQ)
+			break;	/* retried from i_usx2y_out04_int() */
+
+		send = us428ctls->p4out_sent + 1;
+		if (send < 0 || send >= N_US428_P4OUT_BUFS)
+			send = 0;
+		memcpy(&cmd, us428ctls->p4out + send, sizeof(cmd));
+		while (send != last) {
+			next = send + 1;
+			if (next >= N_US428_P4OUT_BUFS)
+				next = 0;
+			if (!usx2y_p4out_merge(&cmd, us428ctls->p4out + next))
+				break;
+			us428ctls->p4out_merged++;
+			send = next;
+		}
+		us428ctls->p4out_sent = send;
+
+		len = cmd.type == ELT_LIGHT ? sizeof(struct us428_lights) :
+					      sizeof(struct usx2y_volume);
+		memcpy(as->urb[i]->transfer_buffer, &cmd.val, len);
+		as->urb[i]->transfer_buffer_length = len;
+		as->urb[i]->dev = usx2y->dev;
+		err = usb_submit_urb(as->urb[i], GFP_ATOMIC);
+		if (err) {
+			us428ctls->p4out_dropped++;
+			snd_printk(KERN_ERR "p4out usb_submit_urb err=%i\n", err);
+			break;
+		}
+		__set_bit(i, &as->busy);
+	}
+	spin_unlock_irqrestore(&as->lock, flags);
+}
+
+/*
+ * pipe 4 is used for switching the lamps, setting samplerate, volumes ....
+ */
+static void i_usx2y_out04_int(struct urb *urb)
+{
+	struct usx2ydev *usx2y = urb->context;
+	struct snd_usx2y_async_seq *as = &usx2y->as04;
+	unsigned long flags;
+	int i;
+
+	for (i = 0; i < URBS_ASYNC_SEQ && as->urb[i] != urb; i++)
+		;
+	if (urb->status)
+		snd_printdd("%s urb %i status=%i\n", __func__, i, urb->status);
+
+	spin_lock_irqsave(&as->lock, flags);
+	if (i < URBS_ASYNC_SEQ)
+		__clear_bit(i, &as->busy);
+	if (urb->status && !as->stopped && usx2y->us428ctls_sharedmem)
+		usx2y->us428ctls_sharedmem->p4out_dropped++;
+	spin_unlock_irqrestore(&as->lock, flags);
+
+	if (!urb->status)
+		usx2y_p4out_flush(usx2y);
 }
 
 static void i_usx2y_in04_int(struct urb *urb)
@@ -173,8 +272,7 @@ static void i_usx2y_in04_int(struct urb *urb)
 	int			err = 0;
 	struct usx2ydev		*usx2y = urb->context;
 	struct us428ctls_sharedmem	*us428ctls = usx2y->us428ctls_sharedmem;
-	struct us428_p4out *p4out;
-	int i, j, n, diff, send;
+	int i, n, diff;
 
 	usx2y->in04_int_calls++;
 
@@ -217,25 +315,7 @@ static void i_usx2y_in04_int(struct urb *urb)
 			} while (!err && usx2y->us04->submitted < usx2y->us04->len);
 		}
 	} else {
-		if (us428ctls && us428ctls->p4out_last >= 0 && us428ctls->p4out_last < N_US428_P4OUT_BUFS) {
-			if (us428ctls->p4out_last != us428ctls->p4out_sent) {
-				send = us428ctls->p4out_sent + 1;
-				if (send >= N_US428_P4OUT_BUFS)
-					send = 0;
-				for (j = 0; j < URBS_ASYNC_SEQ && !err; ++j) {
-					if (!usx2y->as04.urb[j]->status) {
-						p4out = us428ctls->p4out + send;	// FIXME if more than 1 p4out is new, 1 gets lost.
-						usb_fill_bulk_urb(usx2y->as04.urb[j], usx2y->dev,
-								  usb_sndbulkpipe(usx2y->dev, 0x04), &p4out->val.vol,
-								  p4out->type == ELT_LIGHT ? sizeof(struct us428_lights) : 5,
-								  i_usx2y_out04_int, usx2y);
-						err = usb_submit_urb(usx2y->as04.urb[j], GFP_ATOMIC);
-						us428ctls->p4out_sent = send;
-						break;
-					}
-				}
-			}
-		}
+		usx2y_p4out_flush(usx2y);
 	}
 
 	if (err)
@@ -255,6 +335,9 @@ int usx2y_async_seq04_init(struct usx2ydev *usx2y)
 	if (WARN_ON(usx2y->as04.buffer))
 		return -EBUSY;
 
+	usx2y->as04.busy = 0;
+	usx2y->as04.stopped = false;
+
 	usx2y->as04.buffer = kmalloc_array(URBS_ASYNC_SEQ,
 					   URB_DATA_LEN_ASYNC_SEQ, GFP_KERNEL);
 	if (!usx2y->as04.buffer) {
@@ -322,6 +405,9 @@ static void usx2y_unlinkseq(struct snd_usx2y_async_seq *s)
 {
 	int	i;
 
+	spin_lock_irq(&s->lock);
+	s->stopped = true;
+	spin_unlock_irq(&s->lock);
 	for (i = 0; i < URBS_ASYNC_SEQ; ++i) {
 		if (!s->urb[i])
 			continue;
@@ -375,6 +461,7 @@ static int usx2y_create_card(struct usb_device *device,
 	usx2y(card)->dev = device;
 	init_waitqueue_head(&usx2y(card)->prepare_wait_queue);
 	init_waitqueue_head(&usx2y(card)->us428ctls_wait_queue_head);
+	spin_lock_init(&usx2y(card)->as04.lock);
 	mutex_init(&usx2y(card)->pcm_mutex);
 	INIT_LIST_HEAD(&usx2y(card)->midi_list);
 	strcpy(card->driver, "USB "NAME_ALLCAPS"");
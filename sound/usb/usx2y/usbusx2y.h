@@ -13,6 +13,9 @@
 struct snd_usx2y_async_seq {
 	struct urb	*urb[URBS_ASYNC_SEQ];
 	char		*buffer;
+	spinlock_t	lock;		/* protects busy, stopped and p4out_sent */
+	unsigned long	busy;		/* bitmap of urbs in flight */
+	bool		stopped;	/* no more submissions, urbs are killed */
 };
 
 struct snd_usx2y_urb_seq {
@@ -23,6 +26,14 @@ struct snd_usx2y_urb_seq {
 
 #include "usx2yhwdeppcm.h"
 
+struct snd_usx2y_urb_stats {
+	ktime_t		last;		/* last completed usb frame */
+	u64		sum_us;
+	unsigned int	count;
+	unsigned int	min_us, max_us;
+	unsigned int	late;		/* intervals over 1.5 urb lengths */
+};
+
 struct usx2ydev {
 	struct usb_device	*dev;
 	int			card_index;
@@ -40,6 +51,8 @@ struct usx2ydev {
 	struct mutex		pcm_mutex;
 	struct us428ctls_sharedmem	*us428ctls_sharedmem;
 	int			wait_iso_frame;
+	int			nr_packs;	/* packets per urb of the running streams */
+	struct snd_usx2y_urb_stats	urb_stats;
 	wait_queue_head_t	us428ctls_wait_queue_head;
 	struct snd_usx2y_hwdep_pcm_shm	*hwdep_pcm_shm;
 	struct snd_usx2y_substream	*subs[4];
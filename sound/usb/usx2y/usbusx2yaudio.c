@@ -28,7 +28,7 @@
 #include "usx2y.h"
 #include "usbusx2y.h"
 
-/* Default value used for nr of packs per urb.
+/* Maximum nr of packs per urb.
  * 1 to 4 have been tested ok on uhci.
  * To use 3 on ohci, you'd need a patch:
  * look for "0000425-linux-2.6.9-rc4-mm1_ohci-hcd.patch.gz" on
@@ -39,21 +39,75 @@
  */
 #define USX2Y_NRPACKS 4
 
-/* If your system works ok with this module's parameter
- * nrpacks set to 1, you might as well comment
- * this define out, and thereby produce smaller, faster code.
- * You'd also set USX2Y_NRPACKS to 1 then.
+static int nrpacks; /* number of packets per urb, 0 = derive from period size */
+module_param(nrpacks, int, 0444);
+MODULE_PARM_DESC(nrpacks, "Number of packets per URB (0 = derive from period size).");
+
+/*
+ * Pick the packets per urb when the capture pipe, which clocks all streams
+ * of the device, is started.  A period should still span at least two urbs,
+ * so take half a period's worth of 1ms packets.  3 is skipped, see above.
  */
-#define USX2Y_NRPACKS_VARIABLE 1
+static int usx2y_pick_nr_packs(struct snd_pcm_runtime *runtime)
+{
+	int packs;
 
-#ifdef USX2Y_NRPACKS_VARIABLE
-static int nrpacks = USX2Y_NRPACKS; /* number of packets per urb */
-#define  nr_of_packs() nrpacks
-module_param(nrpacks, int, 0444);
-MODULE_PARM_DESC(nrpacks, "Number of packets per URB.");
-#else
-#define nr_of_packs() USX2Y_NRPACKS
-#endif
+	if (nrpacks > 0)
+		return min(nrpacks, USX2Y_NRPACKS);
+
+	packs = runtime->period_size * 1000 / runtime->rate / 2;
+	if (packs >= USX2Y_NRPACKS)
+		return USX2Y_NRPACKS;
+	if (packs >= 2)
+		return 2;
+	return 1;
+}
+
+static void usx2y_urb_stats_reset(struct usx2ydev *usx2y)
+{
+	memset(&usx2y->urb_stats, 0, sizeof(usx2y->urb_stats));
+}
+
+/*
+ * Account the time between two completed usb frames, so the nr of packets
+ * picked by usx2y_pick_nr_packs() can be checked against what the host
+ * controller delivers.
+ */
+static void usx2y_urb_stats_update(struct usx2ydev *usx2y)
+{
+	struct snd_usx2y_urb_stats *st = &usx2y->urb_stats;
+	ktime_t now = ktime_get();
+	unsigned int us;
+
+	if (st->last) {
+		us = ktime_us_delta(now, st->last);
+		if (!st->count || us < st->min_us)
+			st->min_us = us;
+		if (us > st->max_us)
+			st->max_us = us;
+		/* more than 1.5 times the nominal urb length */
+		if (us > usx2y->nr_packs * 1500)
+			st->late++;
+		st->sum_us += us;
+		st->count++;
+	}
+	st->last = now;
+}
+
+static void usx2y_proc_urb_stats_read(struct snd_info_entry *entry,
+				      struct snd_info_buffer *buffer)
+{
+	struct usx2ydev *usx2y = entry->private_data;
+	struct snd_usx2y_urb_stats *st = &usx2y->urb_stats;
+
+	snd_iprintf(buffer, "Packets per URB: %d\n", usx2y->nr_packs);
+	snd_iprintf(buffer, "Completions: %u\n", st->count);
+	if (!st->count)
+		return;
+	snd_iprintf(buffer, "Interval (us): min %u, avg %llu, max %u\n",
+		    st->min_us, div_u64(st->sum_us, st->count), st->max_us);
+	snd_iprintf(buffer, "Late completions: %u\n", st->late);
+}
 
 static int usx2y_urb_capt_retire(struct snd_usx2y_substream *subs)
 {
@@ -64,7 +118,7 @@ static int usx2y_urb_capt_retire(struct snd_usx2y_substream *subs)
 	int		cnt, blen;
 	struct usx2ydev	*usx2y = subs->usx2y;
 
-	for (i = 0; i < nr_of_packs(); i++) {
+	for (i = 0; i < usx2y->nr_packs; i++) {
 		cp = (unsigned char *)urb->transfer_buffer + urb->iso_frame_desc[i].offset;
 		if (urb->iso_frame_desc[i].status) { /* active? hmm, skip this */
 			snd_printk(KERN_ERR
@@ -123,7 +177,7 @@ static int usx2y_urb_play_prepare(struct snd_usx2y_substream *subs,
 	int count, counts, pack, len;
 
 	count = 0;
-	for (pack = 0; pack <  nr_of_packs(); pack++) {
+	for (pack = 0; pack < usx2y->nr_packs; pack++) {
 		/* calculate the size of a packet */
 		counts = cap_urb->iso_frame_desc[pack].actual_length / usx2y->stride;
 		count += counts;
@@ -191,7 +245,7 @@ static int usx2y_urb_submit(struct snd_usx2y_substream *subs, struct urb *urb, i
 
 	if (!urb)
 		return -ENODEV;
-	urb->start_frame = frame + NRURBS * nr_of_packs();  // let hcd do rollover sanity checks
+	urb->start_frame = frame + NRURBS * subs->usx2y->nr_packs;  // let hcd do rollover sanity checks
 	urb->hcpriv = NULL;
 	urb->dev = subs->usx2y->dev; /* we need to set this at each time */
 	err = usb_submit_urb(urb, GFP_ATOMIC);
@@ -321,7 +375,8 @@ static void i_usx2y_urb_complete(struct urb *urb)
 	    (playbacksubs->completed_urb ||
 	     atomic_read(&playbacksubs->state) < STATE_PREPARED)) {
 		if (!usx2y_usbframe_complete(capsubs, playbacksubs, urb->start_frame)) {
-			usx2y->wait_iso_frame += nr_of_packs();
+			usx2y->wait_iso_frame += usx2y->nr_packs;
+			usx2y_urb_stats_update(usx2y);
 		} else {
 			snd_printdd("\n");
 			usx2y_clients_stop(usx2y);
@@ -425,8 +480,9 @@ static int usx2y_urbs_allocate(struct snd_usx2y_substream *subs)
 	if (!subs->maxpacksize)
 		return -EINVAL;
 
+	/* buffers are sized for USX2Y_NRPACKS, so urbs survive a change of nr_packs */
 	if (is_playback && !subs->tmpbuf) {	/* allocate a temporary buffer for playback */
-		subs->tmpbuf = kcalloc(nr_of_packs(), subs->maxpacksize, GFP_KERNEL);
+		subs->tmpbuf = kcalloc(USX2Y_NRPACKS, subs->maxpacksize, GFP_KERNEL);
 		if (!subs->tmpbuf)
 			return -ENOMEM;
 	}
@@ -435,9 +491,10 @@ static int usx2y_urbs_allocate(struct snd_usx2y_substream *subs)
 		purb = subs->urb + i;
 		if (*purb) {
 			usb_kill_urb(*purb);
+			(*purb)->number_of_packets = subs->usx2y->nr_packs;
 			continue;
 		}
-		*purb = usb_alloc_urb(nr_of_packs(), GFP_KERNEL);
+		*purb = usb_alloc_urb(USX2Y_NRPACKS, GFP_KERNEL);
 		if (!*purb) {
 			usx2y_urbs_release(subs);
 			return -ENOMEM;
@@ -446,7 +503,7 @@ static int usx2y_urbs_allocate(struct snd_usx2y_substream *subs)
 			/* allocate a capture buffer per urb */
 			(*purb)->transfer_buffer =
 				kmalloc_array(subs->maxpacksize,
-					      nr_of_packs(), GFP_KERNEL);
+					      USX2Y_NRPACKS, GFP_KERNEL);
 			if (!(*purb)->transfer_buffer) {
 				usx2y_urbs_release(subs);
 				return -ENOMEM;
@@ -454,7 +511,7 @@ static int usx2y_urbs_allocate(struct snd_usx2y_substream *subs)
 		}
 		(*purb)->dev = dev;
 		(*purb)->pipe = pipe;
-		(*purb)->number_of_packets = nr_of_packs();
+		(*purb)->number_of_packets = subs->usx2y->nr_packs;
 		(*purb)->context = subs;
 		(*purb)->interval = 1;
 		(*purb)->complete = i_usx2y_subs_startup;
@@ -498,11 +555,11 @@ static int usx2y_urbs_start(struct snd_usx2y_substream *subs)
 			if (!i)
 				atomic_set(&subs->state, STATE_STARTING3);
 			urb->dev = usx2y->dev;
-			for (pack = 0; pack < nr_of_packs(); pack++) {
+			for (pack = 0; pack < usx2y->nr_packs; pack++) {
 				urb->iso_frame_desc[pack].offset = subs->maxpacksize * pack;
 				urb->iso_frame_desc[pack].length = subs->maxpacksize;
 			}
-			urb->transfer_buffer_length = subs->maxpacksize * nr_of_packs();
+			urb->transfer_buffer_length = subs->maxpacksize * usx2y->nr_packs;
 			err = usb_submit_urb(urb, GFP_ATOMIC);
 			if (err < 0) {
 				snd_printk(KERN_ERR "cannot submit datapipe for urb %d, err = %d\n", i, err);
@@ -868,6 +925,8 @@ static int snd_usx2y_pcm_prepare(struct snd_pcm_substream *substream)
 				goto up_prepare_mutex;
 		}
 		snd_printdd("starting capture pipe for %s\n", subs == capsubs ? "self" : "playpipe");
+		usx2y->nr_packs = usx2y_pick_nr_packs(runtime);
+		usx2y_urb_stats_reset(usx2y);
 		err = usx2y_urbs_start(capsubs);
 		if (err < 0)
 			goto up_prepare_mutex;
@@ -1027,6 +1086,8 @@ int usx2y_audio_create(struct snd_card *card)
 		if (err < 0)
 			return err;
 	}
+	snd_card_ro_proc_new(card, "urb_stats", usx2y(card),
+			     usx2y_proc_urb_stats_read);
 	if (le16_to_cpu(usx2y(card)->dev->descriptor.idProduct) != USB_ID_US122)
 		err = usx2y_rate_set(usx2y(card), 44100);	// Lets us428 recognize output-volume settings, disturbs us122.
 	return err;
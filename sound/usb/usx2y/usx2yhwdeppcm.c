@@ -42,8 +42,6 @@
 #include <linux/gfp.h>
 #include "usbusx2yaudio.c"
 
-#if defined(USX2Y_NRPACKS_VARIABLE) || USX2Y_NRPACKS == 1
-
 #include <sound/hwdep.h>
 
 static int usx2y_usbpcm_urb_capt_retire(struct snd_usx2y_substream *subs)
@@ -61,7 +59,7 @@ static int usx2y_usbpcm_urb_capt_retire(struct snd_usx2y_substream *subs)
 		usx2y->hwdep_pcm_shm->capture_iso_start = head;
 		snd_printdd("cap start %i\n", head);
 	}
-	for (i = 0; i < nr_of_packs(); i++) {
+	for (i = 0; i < usx2y->nr_packs; i++) {
 		if (urb->iso_frame_desc[i].status) { /* active? hmm, skip this */
 			snd_printk(KERN_ERR
 				   "active frame status %i. Most probably some hardware problem.\n",
@@ -116,7 +114,7 @@ static int usx2y_hwdep_urb_play_prepare(struct snd_usx2y_substream *subs,
 	}
 
 	count = 0;
-	for (pack = 0; pack < nr_of_packs(); pack++) {
+	for (pack = 0; pack < usx2y->nr_packs; pack++) {
 		/* calculate the size of a packet */
 		counts = shm->captured_iso[shm->playback_iso_head].length / usx2y->stride;
 		if (counts < 43 || counts > 50) {
@@ -142,9 +140,10 @@ static void usx2y_usbpcm_urb_capt_iso_advance(struct snd_usx2y_substream *subs,
 {
 	struct usb_iso_packet_descriptor *desc;
 	struct snd_usx2y_hwdep_pcm_shm *shm;
+	int nr_packs = urb->number_of_packets;
 	int pack, head;
 
-	for (pack = 0; pack < nr_of_packs(); ++pack) {
+	for (pack = 0; pack < nr_packs; ++pack) {
 		desc = urb->iso_frame_desc + pack;
 		if (subs) {
 			shm = subs->usx2y->hwdep_pcm_shm;
@@ -157,7 +156,7 @@ static void usx2y_usbpcm_urb_capt_iso_advance(struct snd_usx2y_substream *subs,
 			shm->captured_iso_head = head;
 			shm->captured_iso_frames++;
 		}
-		desc->offset += desc->length * NRURBS * nr_of_packs();
+		desc->offset += desc->length * NRURBS * nr_packs;
 		if (desc->offset + desc->length >= SSS)
 			desc->offset -= (SSS - desc->length);
 	}
@@ -253,7 +252,8 @@ static void i_usx2y_usbpcm_urb_complete(struct urb *urb)
 	    (!capsubs2 || capsubs2->completed_urb) &&
 	    (playbacksubs->completed_urb || atomic_read(&playbacksubs->state) < STATE_PREPARED)) {
 		if (!usx2y_usbpcm_usbframe_complete(capsubs, capsubs2, playbacksubs, urb->start_frame)) {
-			usx2y->wait_iso_frame += nr_of_packs();
+			usx2y->wait_iso_frame += usx2y->nr_packs;
+			usx2y_urb_stats_update(usx2y);
 		} else {
 			snd_printdd("\n");
 			usx2y_clients_stop(usx2y);
@@ -330,9 +330,10 @@ static int usx2y_usbpcm_urbs_allocate(struct snd_usx2y_substream *subs)
 		purb = subs->urb + i;
 		if (*purb) {
 			usb_kill_urb(*purb);
+			(*purb)->number_of_packets = subs->usx2y->nr_packs;
 			continue;
 		}
-		*purb = usb_alloc_urb(nr_of_packs(), GFP_KERNEL);
+		*purb = usb_alloc_urb(USX2Y_NRPACKS, GFP_KERNEL);
 		if (!*purb) {
 			usx2y_usbpcm_urbs_release(subs);
 			return -ENOMEM;
@@ -345,7 +346,7 @@ static int usx2y_usbpcm_urbs_allocate(struct snd_usx2y_substream *subs)
 
 		(*purb)->dev = dev;
 		(*purb)->pipe = pipe;
-		(*purb)->number_of_packets = nr_of_packs();
+		(*purb)->number_of_packets = subs->usx2y->nr_packs;
 		(*purb)->context = subs;
 		(*purb)->interval = 1;
 		(*purb)->complete = i_usx2y_usbpcm_subs_startup;
@@ -449,11 +450,11 @@ static int usx2y_usbpcm_urbs_start(struct snd_usx2y_substream *subs)
 				if (!u)
 					atomic_set(&subs->state, STATE_STARTING3);
 				urb->dev = usx2y->dev;
-				for (pack = 0; pack < nr_of_packs(); pack++) {
-					urb->iso_frame_desc[pack].offset = subs->maxpacksize * (pack + u * nr_of_packs());
+				for (pack = 0; pack < usx2y->nr_packs; pack++) {
+					urb->iso_frame_desc[pack].offset = subs->maxpacksize * (pack + u * usx2y->nr_packs);
 					urb->iso_frame_desc[pack].length = subs->maxpacksize;
 				}
-				urb->transfer_buffer_length = subs->maxpacksize * nr_of_packs();
+				urb->transfer_buffer_length = subs->maxpacksize * usx2y->nr_packs;
 				err = usb_submit_urb(urb, GFP_KERNEL);
 				if (err < 0) {
 					snd_printk(KERN_ERR "cannot usb_submit_urb() for urb %d, err = %d\n", u, err);
@@ -530,6 +531,12 @@ static int snd_usx2y_usbpcm_prepare(struct snd_pcm_substream *substream)
 		}
 		snd_printdd("starting capture pipe for %s\n", subs == capsubs ?
 			    "self" : "playpipe");
+		/*
+		 * The shared memory iso ring and its userspace clients were
+		 * only ever run with one packet per urb.
+		 */
+		usx2y->nr_packs = 1;
+		usx2y_urb_stats_reset(usx2y);
 		err = usx2y_usbpcm_urbs_start(capsubs);
 		if (err < 0)
 			goto up_prepare_mutex;
@@ -726,9 +733,6 @@ int usx2y_hwdep_pcm_new(struct snd_card *card)
 	struct snd_pcm *pcm;
 	struct usb_device *dev = usx2y(card)->dev;
 
-	if (nr_of_packs() != 1)
-		return 0;
-
 	err = snd_hwdep_new(card, SND_USX2Y_USBPCM_ID, 1, &hw);
 	if (err < 0)
 		return err;
@@ -764,12 +768,3 @@ int usx2y_hwdep_pcm_new(struct snd_card *card)
 
 	return 0;
 }
-
-#else
-
-int usx2y_hwdep_pcm_new(struct snd_card *card)
-{
-	return 0;
-}
-
-#endif